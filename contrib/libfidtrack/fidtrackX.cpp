@@ -282,6 +282,9 @@ static void compute_fiducial_statistics( FidtrackerX *ft, FiducialX *f,
 	
 	black_x = (double)ft->black_x_sum / (double)ft->black_leaf_count;
 	black_y = (double)ft->black_y_sum / (double)ft->black_leaf_count;
+
+	f->raw_x = all_x;
+	f->raw_y = all_y;
 	
 	if (ft->pixelwarp) {
 		if (ft->total_leaf_count>(ft->black_leaf_count_warped+ft->white_leaf_count_warped)) { 
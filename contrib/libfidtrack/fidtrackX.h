@@ -76,6 +76,7 @@ void terminate_fidtrackerX( FidtrackerX *ft );
 typedef struct FiducialX{
     int id;                                 /* can be INVALID_FIDUCIAL_ID */
     float x, y;
+    float raw_x, raw_y;                     /* position in the image, before pixelwarp */
 	//float a, b;
     float angle;
     float leaf_size;
@@ -21,6 +21,7 @@
 #include "segment.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 
@@ -343,10 +344,43 @@ static void merge_regions( Segmenter *s, Region* r1, Region* r2 )
 }
 
 
+static void find_runs( Segmenter *s, const unsigned char *source, int first_row, int end_row )
+{
+    int x, y, count;
+    const unsigned char *line;
+    short *runs;
+
+    for( y = first_row; y < end_row; ++y ){
+        line = source + y * s->width;
+        runs = s->runs + y * s->width;
+
+        runs[0] = 0;
+        count = 1;
+        for( x = 1; x < s->width; ++x ){
+            // skip uniform spans 8 pixels at a time
+            while( x + 8 <= s->width && memcmp( line + x - 1, line + x, 8 ) == 0 )
+                x += 8;
+            if( x < s->width && line[x] != line[x-1] )
+                runs[count++] = (short)x;
+        }
+        s->run_counts[y] = count;
+    }
+}
+
+
+/*
+    same algorithm as a pixel by pixel raster scan, but the regions are only
+    visited where something can happen: at the start of each run, and where a
+    run of the previous row with the same colour begins under the current run.
+    regions are created, made adjacent and merged in the same order as the
+    raster scan, so the result is identical.
+*/
 static void build_regions( Segmenter *s, const unsigned char *source )
 {
-    //Span *new_span;
-	int x, y, i;
+    int x, y, j, k, end, count, previous_count;
+    unsigned char colour;
+    short *runs, *previous_runs;
+    const unsigned char *line;
     RegionReference **current_row = &s->regions_under_construction[0];
     RegionReference **previous_row = &s->regions_under_construction[s->width];
 
@@ -356,21 +390,14 @@ static void build_regions( Segmenter *s, const unsigned char *source )
 
     // top line
 
-    x = 0;
-    y = 0;
-    current_row[0] = new_region( s, x, y, source[0] );
-    current_row[0]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
-    for( x=1, y=0, i=1 ; x < s->width; ++x, ++i ){
-
-        if( source[i] == source[i-1] ){
-            current_row[x] = current_row[x-1];
-        }else{
-//			current_row[x-1]->region->last_span->end=i-1;
-//			current_row[x-1]->region->area += i-current_row[x-1]->region->last_span->start;
-            current_row[x] = new_region( s, x, y, source[i] );
-            current_row[x]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
-            make_adjacent( s, current_row[x]->region, current_row[x-1]->region );
-        }
+    runs = s->runs;
+    count = s->run_counts[0];
+    for( j = 0; j < count; ++j ){
+        x = runs[j];
+        current_row[j] = new_region( s, x, 0, source[x] );
+        current_row[j]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
+        if( j > 0 )
+            make_adjacent( s, current_row[j]->region, current_row[j-1]->region );
     }
 
     // process lines
@@ -382,109 +409,85 @@ static void build_regions( Segmenter *s, const unsigned char *source )
         previous_row = current_row;
         current_row = temp;
 
-        i = y * s->width;
-        x = 0;
+        previous_runs = runs;
+        previous_count = count;
+        runs = s->runs + y * s->width;
+        count = s->run_counts[y];
+        line = source + y * s->width;
 
-        // left edge
+        k = 0;  // run of the previous row under x
 
-        RESOLVE_REGIONREF_REDIRECTS( previous_row[x], previous_row[x] );
-        if( source[i] == previous_row[x]->region->colour ){
-            current_row[x] = previous_row[x];
-/*
-			new_span = LOOKUP_SEGMENTER_SPAN( s,  i );
-			new_span->start = i;
-			new_span->end = i;
-			new_span->next = NULL;
-			current_row[x]->region->last_span->next = new_span;
-			current_row[x]->region->last_span = new_span;
-*/
-		}else{ // source[i] != previous_row[x]->colour
+        for( j = 0; j < count; ++j ){
+            x = runs[j];
+            end = ( j + 1 < count ) ? runs[j+1] : s->width;
+            colour = line[x];
 
-            current_row[x] = new_region( s, x, y, source[i] );
-            current_row[x]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
-            make_adjacent( s, current_row[x]->region, previous_row[x]->region );
-        }
+            while( k + 1 < previous_count && previous_runs[k+1] <= x )
+                ++k;
 
-        ++i;
-        x=1;
+            RESOLVE_REGIONREF_REDIRECTS( previous_row[k], previous_row[k] );
 
-        // center span
+            if( x == 0 ){
 
-        for( ; x < s->width; ++x, ++i ){
-            //RESOLVE_REGIONREF_REDIRECTS( current_row[x-1], current_row[x-1] );   // this isn't needed because the the west cell's redirect is always up to date
-            RESOLVE_REGIONREF_REDIRECTS( previous_row[x], previous_row[x] );
+                // left edge
 
-            if( source[i] == source[i-1] ){
+                if( colour == previous_row[k]->region->colour ){
+                    current_row[j] = previous_row[k];
+                }else{
+                    current_row[j] = new_region( s, x, y, colour );
+                    current_row[j]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
+                    make_adjacent( s, current_row[j]->region, previous_row[k]->region );
+                }
 
-                current_row[x] = current_row[x-1];
+            }else{
 
-                if( current_row[x] != previous_row[x]
-                        && source[i] == previous_row[x]->region->colour ){
+                if( current_row[j-1]->region->right < x - 1 )
+                    current_row[j-1]->region->right = (short)( x - 1 );
 
-                    // merge the current region into the previous one
-                    // this should be more efficient than merging the previous
-                    // into the current because it keeps long-lived regions
-                    // alive and only frees newer (less connected?) ones
-/*
-					previous_row[x]->region->last_span->next = current_row[x]->region->first_span;
-					previous_row[x]->region->last_span = current_row[x]->region->last_span;
-					previous_row[x]->region->area += current_row[x]->region->area;
-*/
-                    merge_regions( s, previous_row[x]->region, current_row[x]->region );
-                    current_row[x]->region->flags = FREE_REGION_FLAG;
-                    current_row[x]->region->next = s->freed_regions_head;
-                    s->freed_regions_head = current_row[x]->region;
-                    current_row[x]->region = 0;
-                    current_row[x]->redirect = previous_row[x];
-                    current_row[x] = previous_row[x];
+                if( colour == previous_row[k]->region->colour ){
+                    current_row[j] = previous_row[k];
+                    current_row[j]->region->bottom = (short)y;
+                }else{
+                    current_row[j] = new_region( s, x, y, colour );
+                    make_adjacent( s, current_row[j]->region, previous_row[k]->region );
+                    if( current_row[j-1]->region != previous_row[k]->region )
+                        make_adjacent( s, current_row[j]->region, current_row[j-1]->region );
                 }
+            }
 
+            // runs of the previous row beginning under this one
 
-            }else{ // source_image_[i] != source_image_[i-1]
-/*
-				current_row[x-1]->region->last_span->end=i-1; // set the span end, it is more efficient here
-				current_row[x-1]->region->area+=i-current_row[x-1]->region->last_span->start;
-				
-				// mark single pixels fragmented
-				if (current_row[x-1]->region->area<=REGION_GATE_AREA) {
-					if (((y+1)==s->height) || (source[i-1]!=source[i-1+s->width]))
-						make_fragmented(current_row[x-1]->region);
-				}
-*/
-                if( current_row[x-1]->region->right < x - 1 )
-                    current_row[x-1]->region->right = (short)( x - 1 );
+            while( k + 1 < previous_count && previous_runs[k+1] < end ){
+                ++k;
+                RESOLVE_REGIONREF_REDIRECTS( previous_row[k], previous_row[k] );
 
-                if( source[i] == previous_row[x]->region->colour ){
-                    current_row[x] = previous_row[x];
-                    current_row[x]->region->bottom = (short)y;
-/*
-					new_span = LOOKUP_SEGMENTER_SPAN( s,  i );
-					new_span->start = i;
-					new_span->end = i;
-					new_span->next = NULL;
-					current_row[x]->region->last_span->next = new_span;
-					current_row[x]->region->last_span = new_span;
-*/
-                }else{
-                    current_row[x] = new_region( s, x, y, source[i] );
-                    make_adjacent( s, current_row[x]->region, previous_row[x]->region );
-                    if( current_row[x-1]->region != previous_row[x]->region )
-                        make_adjacent( s, current_row[x]->region, current_row[x-1]->region );
+                if( current_row[j] != previous_row[k]
+                        && colour == previous_row[k]->region->colour ){
+
+                    // merge the current region into the previous one
+                    // this should be more efficient than merging the previous
+                    // into the current because it keeps long-lived regions
+                    // alive and only frees newer (less connected?) ones
+                    merge_regions( s, previous_row[k]->region, current_row[j]->region );
+                    current_row[j]->region->flags = FREE_REGION_FLAG;
+                    current_row[j]->region->next = s->freed_regions_head;
+                    s->freed_regions_head = current_row[j]->region;
+                    current_row[j]->region = 0;
+                    current_row[j]->redirect = previous_row[k];
+                    current_row[j] = previous_row[k];
                 }
             }
         }
 
         // right edge
-        current_row[s->width-1]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
-//		current_row[s->width-1]->region->last_span->end=i;
-//		current_row[x-1]->region->area+=i-current_row[x-1]->region->last_span->start+2;
+        current_row[count-1]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
     }
 
     // make regions of bottom row adjacent or merge with root
 
-    for( x = 0; x < s->width; ++x ){
-        RESOLVE_REGIONREF_REDIRECTS( current_row[x], current_row[x] );
-        current_row[x]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
+    for( j = 0; j < count; ++j ){
+        RESOLVE_REGIONREF_REDIRECTS( current_row[j], current_row[j] );
+        current_row[j]->region->flags |= ADJACENT_TO_ROOT_REGION_FLAG;
     }
 }
 
@@ -507,6 +510,9 @@ void initialize_segmenter( Segmenter *s, int width, int height, int max_adjacent
 	s->height = height;
 	
     s->regions_under_construction = (RegionReference**)malloc( sizeof(RegionReference*) * width * 2 );
+
+    s->runs = (short*)malloc( sizeof(short) * width * height );
+    s->run_counts = (int*)malloc( sizeof(int) * height );
 }
 
 void terminate_segmenter( Segmenter *s )
@@ -515,10 +521,26 @@ void terminate_segmenter( Segmenter *s )
     free( s->regions );
 	//free( s->spans );
     free( s->regions_under_construction );
+    free( s->runs );
+    free( s->run_counts );
 }
 
 void step_segmenter( Segmenter *s, const unsigned char *source )
 {
-    if( s->region_refs && s->regions && s->regions_under_construction /*&& s->spans*/) 
+    if( s->region_refs && s->regions && s->regions_under_construction && s->runs /*&& s->spans*/){
+        find_runs( s, source, 0, s->height );
 		build_regions( s, source );
+    }
+}
+
+void find_segmenter_runs( Segmenter *s, const unsigned char *source, int first_row, int end_row )
+{
+    if( s->runs && s->run_counts )
+        find_runs( s, source, first_row, end_row );
+}
+
+void link_segmenter_runs( Segmenter *s, const unsigned char *source )
+{
+    if( s->region_refs && s->regions && s->regions_under_construction && s->runs /*&& s->spans*/)
+        build_regions( s, source );
 }
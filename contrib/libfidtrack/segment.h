@@ -40,6 +40,13 @@ extern "C"
 
     step_segmenter( &s, thresholded_image, WIDTH, HEIGHT );
 
+    or, to split the scan of the image between several threads:
+
+    find_segmenter_runs( &s, thresholded_image, 0, HEIGHT / 2 );        // thread 1
+    find_segmenter_runs( &s, thresholded_image, HEIGHT / 2, HEIGHT );   // thread 2
+    ...
+    link_segmenter_runs( &s, thresholded_image );
+
     ...
 
     terminate_segmenter( &s );
@@ -144,6 +151,9 @@ typedef struct Segmenter{
 	int width, height;
 
     RegionReference **regions_under_construction;
+
+    short *runs;                /* start of each run of equal pixels, width entries per row */
+    int *run_counts;            /* number of runs of each row */
 }Segmenter;
 
 #define LOOKUP_SEGMENTER_REGION( s, index )\
@@ -157,6 +167,15 @@ void terminate_segmenter( Segmenter *segments );
 
 void step_segmenter( Segmenter *segments, const unsigned char *source );
 
+/*
+    find_segmenter_runs() only touches the rows [first_row, end_row), so it
+    can be called concurrently on disjoint strips. link_segmenter_runs() must
+    be called once all the rows are done, and gives exactly the same regions
+    as step_segmenter().
+*/
+void find_segmenter_runs( Segmenter *segments, const unsigned char *source, int first_row, int end_row );
+void link_segmenter_runs( Segmenter *segments, const unsigned char *source );
+
 
 #ifdef __cplusplus
 }
@@ -29,6 +29,8 @@ extern "C"
 typedef struct TiledBernsenThresholder{
     unsigned char *min_max;
     unsigned char *threshold;
+    unsigned char *column_min_max;  /* min and max of each column, for each block row */
+    unsigned char *threshold_line;  /* threshold of each column, for each tile row */
 } TiledBernsenThresholder;
 
 void initialize_tiled_bernsen_thresholder(
@@ -56,6 +58,28 @@ void terminate_tiled_bernsen_thresholder( TiledBernsenThresholder *thresholder )
 void tiled_bernsen_threshold( TiledBernsenThresholder *thresholder,
         unsigned char *dest, const unsigned char *source, int source_stride,
         int width, int height, int tile_size, int contrast_threshold );
+
+
+/*
+    the same work, split in two passes so that each pass can be shared between
+    several threads: first tiled_bernsen_min_max() on all the blocks
+    [0, tiled_bernsen_block_count()), then tiled_bernsen_apply() on all the
+    tile rows [0, tiled_bernsen_tile_rows()). pitch are the size of a line
+    in bytes.
+*/
+
+int tiled_bernsen_block_count( int height, int tile_size );
+int tiled_bernsen_tile_rows( int height, int tile_size );
+
+void tiled_bernsen_min_max( TiledBernsenThresholder *thresholder,
+        const unsigned char *source, int source_stride, int source_pitch,
+        int width, int height, int tile_size, int first_block, int end_block );
+
+void tiled_bernsen_apply( TiledBernsenThresholder *thresholder,
+        unsigned char *dest, int dest_pitch,
+        const unsigned char *source, int source_stride, int source_pitch,
+        int width, int height, int tile_size, int contrast_threshold,
+        int first_tile_row, int end_tile_row );
         
 
 #ifdef __cplusplus
@@ -0,0 +1,121 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#include <assert.h>
+#include <string.h>
+#include "moBoxSums.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// columns += add - sub
+static void _update_columns(unsigned int *columns, const unsigned char *add, const unsigned char *sub, int count) {
+	int x = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; x + 8 <= count; x += 8 ) {
+		__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(add + x)), zero);
+		__m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(sub + x)), zero);
+		__m128i lo = _mm_loadu_si128((const __m128i *)(columns + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(columns + x + 4));
+		lo = _mm_sub_epi32(_mm_add_epi32(lo, _mm_unpacklo_epi16(a, zero)), _mm_unpacklo_epi16(s, zero));
+		hi = _mm_sub_epi32(_mm_add_epi32(hi, _mm_unpackhi_epi16(a, zero)), _mm_unpackhi_epi16(s, zero));
+		_mm_storeu_si128((__m128i *)(columns + x), lo);
+		_mm_storeu_si128((__m128i *)(columns + x + 4), hi);
+	}
+#endif
+	for ( ; x < count; x++ )
+		columns[x] += add[x] - sub[x];
+}
+
+moBoxSums::moBoxSums() {
+	this->src = NULL;
+	this->radius = 0;
+	this->y = 0;
+}
+
+moBoxSums::~moBoxSums() {
+}
+
+const unsigned char *moBoxSums::row(int y) {
+	if ( y < 0 )
+		y = 0;
+	if ( y >= this->src->height )
+		y = this->src->height - 1;
+	return (const unsigned char *)this->src->imageData + y * this->src->widthStep;
+}
+
+void moBoxSums::start(IplImage *src, int radius) {
+	int count = src->width * src->nChannels;
+	const unsigned char *pixels;
+
+	assert( src->depth == IPL_DEPTH_8U );
+
+	this->src = src;
+	this->radius = radius < 0 ? 0 : radius;
+	this->y = 0;
+	this->columns.assign(count, 0);
+	this->line.resize(count);
+
+	for ( int k = -this->radius; k <= this->radius; k++ ) {
+		pixels = this->row(k);
+		for ( int x = 0; x < count; x++ )
+			this->columns[x] += pixels[x];
+	}
+}
+
+void moBoxSums::next() {
+	this->y++;
+	_update_columns(&this->columns[0], this->row(this->y + this->radius),
+		this->row(this->y - this->radius - 1), this->columns.size());
+}
+
+const unsigned int *moBoxSums::getLine() {
+	int channels = this->src->nChannels;
+	int width = this->src->width;
+	int r = this->radius;
+	const unsigned int *columns = &this->columns[0];
+	unsigned int *line = &this->line[0];
+	unsigned int sum;
+	int x, k;
+
+	for ( int c = 0; c < channels; c++ ) {
+		// box of the first pixel, left border replicated
+		sum = columns[c] * (r + 1);
+		for ( k = 1; k <= r; k++ )
+			sum += columns[(k < width ? k : width - 1) * channels + c];
+		line[c] = sum;
+
+		for ( x = 1; x < width; x++ ) {
+			k = x + r < width ? x + r : width - 1;
+			sum += columns[k * channels + c];
+			k = x - r - 1 > 0 ? x - r - 1 : 0;
+			sum -= columns[k * channels + c];
+			line[x * channels + c] = sum;
+		}
+	}
+
+	return line;
+}
+
+int moBoxSums::getArea() {
+	return (2 * this->radius + 1) * (2 * this->radius + 1);
+}
+
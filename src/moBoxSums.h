@@ -0,0 +1,67 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#ifndef MO_BOX_SUMS_H
+#define MO_BOX_SUMS_H
+
+#include <vector>
+#include "cv.h"
+
+/*! \brief Box sums of an 8 bits image, one line at a time
+ *
+ * The sums of the (2 * radius + 1) lines around the current line are kept
+ * for each column, and updated with two lines when moving to the next
+ * line: the cost doesn't depend on the radius. The image borders are
+ * replicated, as cvSmooth does.
+ */
+class moBoxSums {
+public:
+	moBoxSums();
+	virtual ~moBoxSums();
+
+	/*! \brief Start on the first line of the image
+	 */
+	void start(IplImage *src, int radius);
+
+	/*! \brief Move to the next line
+	 */
+	void next();
+
+	/*! \brief Sums of the box around each value of the current line
+	 *
+	 * There are width * nChannels sums, channels are not mixed.
+	 */
+	const unsigned int *getLine();
+
+	/*! \brief Number of pixels in a box
+	 */
+	int getArea();
+
+private:
+	IplImage *src;
+	int radius;
+	int y;
+	std::vector<unsigned int> columns;
+	std::vector<unsigned int> line;
+
+	const unsigned char *row(int y);
+};
+
+#endif
+
@@ -20,11 +20,15 @@
 
 #include "moDataStream.h"
 #include "moModule.h"
+#include "moUtils.h"
 
 moDataStream::moDataStream(std::string format) {
 	this->format = format;
 	this->data	 = NULL;
 	this->mtx	 = new pt::mutex();
+	this->frame.id = 0;
+	this->frame.timestamp = 0.;
+	mo_frame_reset_transform(this->frame);
 }
 
 moDataStream::~moDataStream() {
@@ -48,8 +52,19 @@ void moDataStream::unlock() {
 }
 
 void moDataStream::push(void *data) {
+	mo_frame_t frame;
+
+	// no frame given, the data is the start of a new frame
+	frame.id = this->frame.id + 1;
+	frame.timestamp = moUtils::time();
+	mo_frame_reset_transform(frame);
+	this->push(data, frame);
+}
+
+void moDataStream::push(void *data, const mo_frame_t &frame) {
 	this->lock();
 	this->data = data;
+	this->frame = frame;
 	this->unlock();
 
 	this->notifyObservers();
@@ -83,6 +98,10 @@ void *moDataStream::getData() {
 	return this->data;
 }
 
+mo_frame_t moDataStream::getFrame() {
+	return this->frame;
+}
+
 unsigned int moDataStream::getObserverCount() {
 	return this->observers.size();
 }
@@ -26,6 +26,76 @@
 
 class moModule;
 
+/*! \brief Informations on the frame a data have been produced from
+ *
+ * The transform convert the normalized coordinates of the data to the
+ * normalized coordinates of the source frame, as they must be reported:
+ *     X = t[0] * x + t[1] * y + t[2]
+ *     Y = t[3] * x + t[4] * y + t[5]
+ * A module that crop the image (Roi) or that only change the geometry
+ * (MirrorImage in coordinates mode) update it instead of touching the
+ * pixels, and the modules that output positions apply it once.
+ */
+typedef struct {
+	unsigned int id;		/*< frame number, given by the source of the stream */
+	double timestamp;		/*< capture time of the frame, see moUtils::time() */
+	double transform[6];	/*< data to source frame coordinates */
+} mo_frame_t;
+
+/*! \brief Reset the transform of the frame to identity
+ */
+inline void mo_frame_reset_transform(mo_frame_t &frame) {
+	frame.transform[0] = 1.; frame.transform[1] = 0.; frame.transform[2] = 0.;
+	frame.transform[3] = 0.; frame.transform[4] = 1.; frame.transform[5] = 0.;
+}
+
+/*! \brief Restrict the data to a part of it
+ *
+ * x, y, width and height are normalized in the current data.
+ */
+inline void mo_frame_crop(mo_frame_t &frame, double x, double y, double width, double height) {
+	double *t = frame.transform;
+	t[2] += t[0] * x + t[1] * y;
+	t[5] += t[3] * x + t[4] * y;
+	t[0] *= width;  t[1] *= height;
+	t[3] *= width;  t[4] *= height;
+}
+
+/*! \brief Apply a transform to the reported coordinates
+ *
+ * m is applied after the current transform, in the same form.
+ */
+inline void mo_frame_transform(mo_frame_t &frame, const double m[6]) {
+	double t[6];
+	t[0] = m[0] * frame.transform[0] + m[1] * frame.transform[3];
+	t[1] = m[0] * frame.transform[1] + m[1] * frame.transform[4];
+	t[2] = m[0] * frame.transform[2] + m[1] * frame.transform[5] + m[2];
+	t[3] = m[3] * frame.transform[0] + m[4] * frame.transform[3];
+	t[4] = m[3] * frame.transform[1] + m[4] * frame.transform[4];
+	t[5] = m[3] * frame.transform[2] + m[4] * frame.transform[5] + m[5];
+	for ( int i = 0; i < 6; i++ )
+		frame.transform[i] = t[i];
+}
+
+/*! \brief Convert a normalized position of the data to the source frame
+ */
+inline void mo_frame_to_source(const mo_frame_t &frame, double &x, double &y) {
+	const double *t = frame.transform;
+	double sx = t[0] * x + t[1] * y + t[2];
+	y = t[3] * x + t[4] * y + t[5];
+	x = sx;
+}
+
+/*! \brief Convert a normalized position of the source frame to the data
+ */
+inline void mo_frame_from_source(const mo_frame_t &frame, double &x, double &y) {
+	const double *t = frame.transform;
+	double det = t[0] * t[4] - t[1] * t[3];
+	double dx = x - t[2], dy = y - t[5];
+	x = (t[4] * dx - t[1] * dy) / det;
+	y = (t[0] * dy - t[3] * dx) / det;
+}
+
 class moDataStreamInfo {
 public:
 	moDataStreamInfo(const std::string &name,
@@ -67,7 +137,9 @@ public:
 	moModule *getObserver(unsigned int index);
 
 	void push(void *data);
+	void push(void *data, const mo_frame_t &frame);
 	void *getData();
+	mo_frame_t getFrame();
 
 	void lock();
 	void unlock();
@@ -78,6 +150,7 @@ public:
 protected:
 	std::string format;
 	void *data;
+	mo_frame_t frame;
 	std::vector<moModule*> observers;
 	pt::mutex *mtx;
 
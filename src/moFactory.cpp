@@ -33,10 +33,12 @@ static moFactory *instance = NULL;
 void moFactory::init() {
 	REGISTER_MODULE(Amplify);
 	REGISTER_MODULE(BackgroundSubtract);
+	REGISTER_MODULE(BernsenThreshold);
 	REGISTER_MODULE(BlobTracker)
 	REGISTER_MODULE(BlobFinder)
 	REGISTER_MODULE(Camera);
 	REGISTER_MODULE(Combine);
+	REGISTER_MODULE(Downscale);
 	REGISTER_MODULE(Dump);
 	REGISTER_MODULE(FiducialTracker);
 	REGISTER_MODULE(GrayScale);
@@ -48,10 +50,13 @@ void moFactory::init() {
 	REGISTER_MODULE(Justify);
 	REGISTER_MODULE(Mask);
 	REGISTER_MODULE(MirrorImage);
+	REGISTER_MODULE(Morphology);
 	REGISTER_MODULE(Smooth);
+	REGISTER_MODULE(Refine);
 	REGISTER_MODULE(Roi);
 	REGISTER_MODULE(Threshold);
 	REGISTER_MODULE(Tuio);
+	REGISTER_MODULE(TuioProbe);
 	REGISTER_MODULE(Video);
 	REGISTER_MODULE(Erode);
 	REGISTER_MODULE(Dilate);
@@ -0,0 +1,103 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#include "moFrameJoin.h"
+#include "moUtils.h"
+
+moFrameJoin::moFrameJoin() {
+	this->timeout = 0.;
+	this->latest = true;
+	this->reset();
+}
+
+moFrameJoin::~moFrameJoin() {
+}
+
+void moFrameJoin::setInputs(int count) {
+	if ( (int)this->ids.size() == count )
+		return;
+	this->ids.resize(count);
+	this->received.resize(count);
+	this->reset();
+}
+
+void moFrameJoin::setTimeout(double timeout, bool latest) {
+	this->timeout = timeout;
+	this->latest = latest;
+}
+
+void moFrameJoin::reset() {
+	this->ids.assign(this->ids.size(), 0);
+	this->received.assign(this->received.size(), false);
+	this->waiting = 0;
+	this->pending = false;
+	this->since = 0.;
+}
+
+bool moFrameJoin::notify(int index, const mo_frame_t &frame) {
+	unsigned int i;
+
+	if ( index < 0 || index >= (int)this->ids.size() )
+		return false;
+
+	this->ids[index] = frame.id;
+	this->received[index] = true;
+
+	// the timeout count from the first data of the wait, not from the
+	// newest frame, or an input that never come would block the others
+	if ( !this->pending ) {
+		this->pending = true;
+		this->since = moUtils::time();
+		this->waiting = frame.id;
+	}
+
+	// only go forward, a late input can't complete an older frame anymore
+	if ( frame.id != 0 && (this->waiting == 0 || (int)(frame.id - this->waiting) > 0) )
+		this->waiting = frame.id;
+
+	for ( i = 0; i < this->ids.size(); i++ ) {
+		if ( !this->received[i] )
+			break;
+		if ( this->ids[i] != 0 && this->waiting != 0 && this->ids[i] != this->waiting )
+			break;
+	}
+	if ( i == this->ids.size() ) {
+		this->pending = false;
+		return true;
+	}
+
+	return this->expired();
+}
+
+bool moFrameJoin::expired() {
+	if ( !this->pending || this->timeout <= 0. )
+		return false;
+	if ( moUtils::time() - this->since < this->timeout )
+		return false;
+
+	this->pending = false;
+	if ( !this->latest )
+		return false;
+
+	// nothing to combine with an input that never sent data
+	for ( unsigned int i = 0; i < this->received.size(); i++ )
+		if ( !this->received[i] )
+			return false;
+	return true;
+}
+
@@ -0,0 +1,76 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_FRAME_JOIN_H
+#define MO_FRAME_JOIN_H
+
+#include <vector>
+#include "moDataStream.h"
+
+/*! \brief Wait for the same frame on all the inputs of a module
+ *
+ * A module with several inputs call notify() from notifyData(), and update
+ * only when it returns true: every input then hold the data of the same
+ * frame (id), the newest seen. An input without frame information (id 0)
+ * match any frame. A frame that is not complete after the timeout is given
+ * up: the module update with the latest available data of each input, or
+ * skip it. As notifyData(), the calls must be done with the module locked.
+ */
+class moFrameJoin {
+public:
+	moFrameJoin();
+	virtual ~moFrameJoin();
+
+	/*! \brief Set the number of inputs to join
+	 */
+	void setInputs(int count);
+
+	/*! \brief Give up a frame after timeout seconds (0 wait forever)
+	 *
+	 * \param latest if true, the module update with the latest data
+	 */
+	void setTimeout(double timeout, bool latest);
+
+	/*! \brief An input received a frame
+	 *
+	 * \return true if the module must be updated
+	 */
+	bool notify(int index, const mo_frame_t &frame);
+
+	/*! \brief Check the timeout without new data (from poll())
+	 *
+	 * \return true if the module must be updated
+	 */
+	bool expired();
+
+	/*! \brief Forget the frames received
+	 */
+	void reset();
+
+private:
+	std::vector<unsigned int> ids;
+	std::vector<bool> received;
+	unsigned int waiting;
+	bool pending;
+	double since;
+	double timeout;
+	bool latest;
+};
+
+#endif
+
@@ -80,6 +80,7 @@ moModule::moModule(unsigned int capabilities, int input_count, int output_count)
 	this->is_started	= false;
 	this->owner			= NULL;
 	this->is_error		= false;
+	this->is_finished	= false;
 	this->error_msg		= "";
 	this->thread		= NULL;
 	this->use_thread	= false;
@@ -314,6 +315,14 @@ void moModule::setError(const std::string& msg) {
 	this->is_error = true;
 }
 
+bool moModule::isFinished() {
+	return this->is_finished;
+}
+
+void moModule::setFinished() {
+	this->is_finished = true;
+}
+
 std::string moModule::getLastError() {
 	std::ostringstream oss;
 	this->is_error = false;
@@ -247,6 +247,10 @@ public:
 	 */
 	virtual bool haveError();
 
+	/*! \brief Indicate if the module have done its work (test mode stop)
+	 */
+	virtual bool isFinished();
+
 	/*! \brief Check if the module need to be updated
 	 */
 	bool needUpdate(bool lock=false);
@@ -280,6 +284,10 @@ private:
 	 */
 	std::string error_msg;
 
+	/*! \brief Indicate if the module have done its work
+	 */
+	bool is_finished;
+
 	/*! \brief Store the thread instance if it's used
 	 */
 	moThread *thread;
@@ -346,6 +354,10 @@ protected:
 	 */
 	void setError(const std::string &msg);
 
+	/*! \brief Set the finished state on the class
+	 */
+	void setFinished();
+
 	/*! \brief Create a uniq id for the instance of the class
 	 *
 	 * \param base name of the class to use it
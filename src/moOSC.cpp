@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _WIN32
 	#include <WinSock2.h>
@@ -26,6 +27,7 @@
 	#define close(s) shutdown(s, SD_BOTH)
 #else // OTHERS
 	#include <errno.h>
+	#include <unistd.h>
 	#include <sys/types.h>
 	#include <sys/socket.h>
 	#include <netinet/in.h>
@@ -60,30 +62,27 @@ void moOSC::init() {
 		LOG(MO_ERROR, "=> errno=" << errno);
 #endif
 	}
+
+	// resolve the destination once, not on every packet
+	memset(&this->addr, 0, sizeof(this->addr));
+	this->addr.sin_family = AF_INET;
+	this->addr.sin_addr.s_addr = inet_addr(this->ip.c_str());
+	this->addr.sin_port = htons(this->port);
 }
 
 void moOSC::send(WOscMessage *msg) {
-	struct sockaddr_in servaddr = {0};
-
-	servaddr.sin_family = AF_INET;
-	servaddr.sin_addr.s_addr = inet_addr(this->ip.c_str());
-	servaddr.sin_port = htons(this->port);
-
-	sendto(this->sock, msg->GetBuffer(), msg->GetBufferLen(), 0,
-		 (struct sockaddr *)&servaddr, sizeof(servaddr));
+	this->send(msg->GetBuffer(), msg->GetBufferLen());
 }
 
 void moOSC::send(WOscBundle *msg) {
-	struct sockaddr_in servaddr = {0};
-	ssize_t ret;
+	this->send(msg->GetBuffer(), msg->GetBufferLen());
+}
 
-	servaddr.sin_family = AF_INET;
-	servaddr.sin_addr.s_addr = inet_addr(this->ip.c_str());
-	servaddr.sin_port = htons(this->port);
+void moOSC::send(const char *buffer, unsigned int size) {
+	ssize_t ret;
 
-	ret = sendto(this->sock, msg->GetBuffer(), msg->GetBufferLen(), 0,
-		 (struct sockaddr *)&servaddr, sizeof(servaddr));
+	ret = sendto(this->sock, buffer, size, 0,
+		 (struct sockaddr *)&this->addr, sizeof(this->addr));
 
-	LOG(MO_TRACE, "send " << ret << " vs " << msg->GetBufferLen());
+	LOG(MO_TRACE, "send " << ret << " vs " << size);
 }
-
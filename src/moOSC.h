@@ -23,17 +23,25 @@
 #include "WOscMessage.h"
 #include <iostream>
 
+#ifdef _WIN32
+	#include <WinSock2.h>
+#else
+	#include <netinet/in.h>
+#endif
+
 class moOSC {
 public:
 	moOSC(const std::string &ip, unsigned short port);
 	virtual ~moOSC();
 	void send(WOscMessage *msg);
 	void send(WOscBundle *msg);
+	void send(const char *buffer, unsigned int size);
 
 private:
 	void init();
 
 	int sock;
+	struct sockaddr_in addr;
 	std::string ip;
 	unsigned short port;
 };
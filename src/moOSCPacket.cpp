@@ -0,0 +1,178 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+//
+// moOSCPacket.cpp
+//
+// Minimal OSC 1.0 serializer: int32, float32 and string arguments,
+// big-endian, padded on 4 bytes.
+//
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "moOSCPacket.h"
+
+// default capacity, enough for a full size UDP datagram
+#define OSC_PACKET_CAPACITY 2048
+
+moOSCPacket::moOSCPacket() {
+	this->buffer.resize(OSC_PACKET_CAPACITY);
+	this->clear();
+}
+
+moOSCPacket::~moOSCPacket() {
+}
+
+void moOSCPacket::clear() {
+	this->length = 0;
+	this->in_bundle = false;
+	this->message_start = 0;
+	this->types_start = 0;
+	this->types_count = 0;
+	this->args = 0;
+}
+
+char *moOSCPacket::reserve(unsigned int size) {
+	char *ptr;
+	if ( this->length + size > this->buffer.size() )
+		this->buffer.resize((this->length + size) * 2);
+	ptr = &this->buffer[this->length];
+	this->length += size;
+	return ptr;
+}
+
+void moOSCPacket::writeInt32(unsigned int value) {
+	unsigned char *ptr = (unsigned char *)this->reserve(4);
+	ptr[0] = (value >> 24) & 0xff;
+	ptr[1] = (value >> 16) & 0xff;
+	ptr[2] = (value >> 8) & 0xff;
+	ptr[3] = value & 0xff;
+}
+
+void moOSCPacket::writePadded(const char *str, unsigned int len) {
+	// at least one terminating zero, then pad to 4 bytes
+	unsigned int padded = (len + 4) & ~3;
+	char *ptr = this->reserve(padded);
+	memcpy(ptr, str, len);
+	memset(ptr + len, 0, padded - len);
+}
+
+void moOSCPacket::beginBundle(double timetag) {
+	double seconds;
+
+	this->clear();
+	this->writePadded("#bundle", 7);
+	if ( timetag <= 0. ) {
+		// time tag 1 mean "immediately"
+		this->writeInt32(0);
+		this->writeInt32(1);
+	} else {
+		// NTP format, 32 bits of seconds and 32 bits of fraction
+		seconds = floor(timetag);
+		this->writeInt32((unsigned int)seconds + OSC_TIMETAG_EPOCH);
+		this->writeInt32((unsigned int)((timetag - seconds) * 4294967296.));
+	}
+	this->in_bundle = true;
+}
+
+void moOSCPacket::beginMessage(const char *address, const char *types) {
+	unsigned int len = strlen(types);
+	char *ptr;
+
+	// in a bundle, each element is prefixed by its size
+	this->message_start = this->length;
+	if ( this->in_bundle )
+		this->writeInt32(0);
+
+	this->writePadded(address, strlen(address));
+
+	ptr = this->reserve((len + 5) & ~3);
+	ptr[0] = ',';
+	memcpy(ptr + 1, types, len);
+	memset(ptr + 1 + len, 0, ((len + 5) & ~3) - len - 1);
+
+	this->types_start = this->length - ((len + 5) & ~3) + 1;
+	this->types_count = len;
+	this->args = 0;
+}
+
+// the next argument must be of the next type tag
+void moOSCPacket::checkArgument(char type) {
+	assert( this->args < this->types_count );
+	assert( this->buffer[this->types_start + this->args] == type );
+	this->args++;
+}
+
+void moOSCPacket::addInt(int value) {
+	this->checkArgument('i');
+	this->writeInt32((unsigned int)value);
+}
+
+void moOSCPacket::addFloat(float value) {
+	unsigned int raw;
+	assert( sizeof(float) == sizeof(unsigned int) );
+	this->checkArgument('f');
+	memcpy(&raw, &value, sizeof(raw));
+	this->writeInt32(raw);
+}
+
+void moOSCPacket::addString(const char *value) {
+	this->checkArgument('s');
+	this->writePadded(value, strlen(value));
+}
+
+void moOSCPacket::endMessage() {
+	unsigned int size;
+	unsigned char *ptr;
+
+	// as many arguments as type tags
+	assert( this->args == this->types_count );
+
+	if ( !this->in_bundle )
+		return;
+
+	size = this->length - this->message_start - 4;
+	ptr = (unsigned char *)&this->buffer[this->message_start];
+	ptr[0] = (size >> 24) & 0xff;
+	ptr[1] = (size >> 16) & 0xff;
+	ptr[2] = (size >> 8) & 0xff;
+	ptr[3] = size & 0xff;
+}
+
+void moOSCPacket::addMessage(const moOSCPacket &message) {
+	assert( this->in_bundle );
+	this->writeInt32(message.size());
+	memcpy(this->reserve(message.size()), message.getBuffer(), message.size());
+}
+
+void moOSCPacket::truncate(unsigned int size) {
+	assert( size <= this->length );
+	this->length = size;
+}
+
+unsigned int moOSCPacket::size() const {
+	return this->length;
+}
+
+const char *moOSCPacket::getBuffer() const {
+	if ( this->buffer.empty() )
+		return NULL;
+	return &this->buffer[0];
+}
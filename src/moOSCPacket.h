@@ -0,0 +1,93 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_OSC_PACKET_H
+#define MO_OSC_PACKET_H
+
+#include <vector>
+
+// seconds between 1900 (OSC time tag) and 1970 (unix time)
+#define OSC_TIMETAG_EPOCH	2208988800UL
+
+/*! \brief OSC packet (message or bundle) serialized in a reusable buffer
+ *
+ * The buffer grows when needed, and is never shrinked: once the packet have
+ * been used for a few frames, building a new one doesn't allocate anything.
+ */
+class moOSCPacket {
+public:
+	moOSCPacket();
+	virtual ~moOSCPacket();
+
+	/*! \brief Empty the packet (keep the allocated buffer)
+	 */
+	void clear();
+
+	/*! \brief Start a bundle
+	 *
+	 * \param timetag time of the bundle in seconds (as moUtils::time()),
+	 *                0 to be executed immediately
+	 */
+	void beginBundle(double timetag = 0.);
+
+	/*! \brief Start a message
+	 *
+	 * \param address OSC address of the message
+	 * \param types type tags of the arguments (i, f or s), without the leading ','
+	 */
+	void beginMessage(const char *address, const char *types);
+
+	void addInt(int value);
+	void addFloat(float value);
+	void addString(const char *value);
+
+	/*! \brief Finish the current message
+	 *
+	 * The arguments added must match the type tags given to beginMessage().
+	 */
+	void endMessage();
+
+	/*! \brief Append a complete message into the current bundle
+	 */
+	void addMessage(const moOSCPacket &message);
+
+	/*! \brief Cut the packet back to a previous size
+	 */
+	void truncate(unsigned int size);
+
+	unsigned int size() const;
+	const char *getBuffer() const;
+
+private:
+	std::vector<char> buffer;
+	unsigned int length;
+	bool in_bundle;
+	unsigned int message_start;
+	// type tags of the current message, and arguments added so far
+	unsigned int types_start;
+	unsigned int types_count;
+	unsigned int args;
+
+	char *reserve(unsigned int size);
+	void writePadded(const char *str, unsigned int len);
+	void writeInt32(unsigned int value);
+	void checkArgument(char type);
+};
+
+#endif
+
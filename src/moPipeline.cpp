@@ -189,6 +189,15 @@ bool moPipeline::haveError() {
 	return false;
 }
 
+bool moPipeline::isFinished() {
+	std::vector<moModule *>::iterator it;
+	for ( it = this->modules.begin(); it != this->modules.end(); it++ ) {
+		if ( (*it)->isFinished() )
+			return true;
+	}
+	return false;
+}
+
 std::string moPipeline::getLastError() {
 	std::vector<moModule *>::iterator it;
 	if ( last_internal_error != "" )
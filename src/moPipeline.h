@@ -64,6 +64,10 @@ public:
 	 */
 	virtual bool haveError();
 
+	/*! \brief Indicate if a module of the pipeline have done its work
+	 */
+	virtual bool isFinished();
+
 	/*! \brief Dump the pipeline into a file
 	 */
 	virtual std::string serializeCreation();
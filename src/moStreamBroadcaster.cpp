@@ -0,0 +1,217 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#include <assert.h>
+#include "moStreamBroadcaster.h"
+#include "moDataStream.h"
+#include "moLog.h"
+#include "highgui.h"
+
+LOG_DECLARE("StreamBroadcaster");
+
+// all the broadcasters, only used from the http server
+static std::vector<moStreamBroadcaster *> broadcasters;
+
+moStreamBroadcaster *moStreamBroadcaster::acquire(moDataStream *stream, int scale, int quality) {
+	moStreamBroadcaster *broadcaster;
+
+	if ( scale < 1 )
+		scale = 1;
+	if ( quality < 1 || quality > 100 )
+		quality = MO_STREAM_DEFAULT_QUALITY;
+
+	for ( unsigned int i = 0; i < broadcasters.size(); i++ ) {
+		broadcaster = broadcasters[i];
+		if ( broadcaster->input != stream || broadcaster->scale != scale
+			 || broadcaster->quality != quality )
+			continue;
+		broadcaster->references++;
+		return broadcaster;
+	}
+
+	broadcaster = new moStreamBroadcaster(stream, scale, quality);
+	broadcasters.push_back(broadcaster);
+	return broadcaster;
+}
+
+void moStreamBroadcaster::release(moStreamBroadcaster *broadcaster) {
+	std::vector<moStreamBroadcaster *>::iterator it;
+
+	if ( --broadcaster->references > 0 )
+		return;
+
+	for ( it = broadcasters.begin(); it != broadcasters.end(); it++ ) {
+		if ( *it != broadcaster )
+			continue;
+		broadcasters.erase(it);
+		break;
+	}
+	delete broadcaster;
+}
+
+moStreamBroadcaster::moStreamBroadcaster(moDataStream *stream, int scale, int quality) :
+	moModule(MO_MODULE_INPUT, 1, 0) {
+	this->input = NULL;
+	this->scale = scale;
+	this->quality = quality;
+	this->references = 1;
+	this->buffer = NULL;
+	this->converted = NULL;
+	this->sequence = 0;
+	this->callback = NULL;
+	this->userdata = NULL;
+	this->jpeg_mtx = new pt::mutex();
+
+	this->properties["id"] = new moProperty(moModule::createId("WebStream"));
+
+	// encode on our own thread, the producer only notify
+	this->property("use_thread").set(true);
+	this->setInput(stream);
+	this->start();
+}
+
+moStreamBroadcaster::~moStreamBroadcaster() {
+	this->setInput(NULL);
+	this->stop();
+	if ( this->buffer != NULL )
+		cvReleaseImage(&this->buffer);
+	if ( this->converted != NULL )
+		cvReleaseImage(&this->converted);
+	delete this->jpeg_mtx;
+}
+
+void moStreamBroadcaster::setInput(moDataStream *stream, int n) {
+	if ( this->input != NULL )
+		this->input->removeObserver(this);
+	this->input = stream;
+	if ( this->input != NULL )
+		this->input->addObserver(this);
+}
+
+moDataStream *moStreamBroadcaster::getInput(int n) {
+	return this->input;
+}
+
+moDataStream *moStreamBroadcaster::getOutput(int n) {
+	return NULL;
+}
+
+void moStreamBroadcaster::notifyData(moDataStream *source) {
+	this->notifyUpdate();
+}
+
+bool moStreamBroadcaster::getFrame(unsigned int &sequence, std::vector<unsigned char> &data) {
+	bool updated = false;
+
+	this->jpeg_mtx->lock();
+	if ( this->sequence != sequence && !this->jpeg.empty() ) {
+		data = this->jpeg;
+		sequence = this->sequence;
+		updated = true;
+	}
+	this->jpeg_mtx->unlock();
+
+	return updated;
+}
+
+unsigned int moStreamBroadcaster::getSequence() {
+	unsigned int sequence;
+
+	this->jpeg_mtx->lock();
+	sequence = this->jpeg.empty() ? 0 : this->sequence;
+	this->jpeg_mtx->unlock();
+
+	return sequence;
+}
+
+void moStreamBroadcaster::setCallback(moStreamBroadcasterCallback callback, void *userdata) {
+	this->jpeg_mtx->lock();
+	this->callback = callback;
+	this->userdata = userdata;
+	this->jpeg_mtx->unlock();
+}
+
+void moStreamBroadcaster::update() {
+	moDataStream *input = this->input;
+	moStreamBroadcasterCallback callback;
+	std::vector<int> params;
+	IplImage *src, *img;
+	void *userdata;
+	CvSize size;
+
+	if ( input == NULL )
+		return;
+
+	// copy the image, and release the input as fast as we can
+	input->lock();
+	src = static_cast<IplImage *>(input->getData());
+	if ( src == NULL || src->imageData == NULL ) {
+		input->unlock();
+		return;
+	}
+	size = cvSize(src->width / this->scale, src->height / this->scale);
+	if ( this->buffer == NULL || this->buffer->width != size.width
+		 || this->buffer->height != size.height || this->buffer->depth != src->depth
+		 || this->buffer->nChannels != src->nChannels ) {
+		if ( this->buffer != NULL )
+			cvReleaseImage(&this->buffer);
+		this->buffer = cvCreateImage(size, src->depth, src->nChannels);
+	}
+	if ( this->scale == 1 )
+		cvCopy(src, this->buffer);
+	else
+		cvResize(src, this->buffer);
+	input->unlock();
+
+	// if the depth is not a 8, convert to 8 bytes depth
+	img = this->buffer;
+	if ( img->depth != IPL_DEPTH_8U ) {
+		if ( this->converted == NULL || this->converted->width != size.width
+			 || this->converted->height != size.height
+			 || this->converted->nChannels != img->nChannels ) {
+			if ( this->converted != NULL )
+				cvReleaseImage(&this->converted);
+			this->converted = cvCreateImage(size, IPL_DEPTH_8U, img->nChannels);
+		}
+		cvConvertScale(img, this->converted, 255, 0);
+		img = this->converted;
+	}
+
+	// imencode take BGR images, as they are in the pipeline
+	params.push_back(CV_IMWRITE_JPEG_QUALITY);
+	params.push_back(this->quality);
+	this->encoded.clear();
+	if ( !cv::imencode(".jpg", img, this->encoded, params) ) {
+		LOG(MO_ERROR, "unable to encode the image");
+		return;
+	}
+
+	this->jpeg_mtx->lock();
+	this->jpeg.swap(this->encoded);
+	this->sequence++;
+	if ( this->sequence == 0 )
+		this->sequence++;
+	callback = this->callback;
+	userdata = this->userdata;
+	this->jpeg_mtx->unlock();
+
+	// tell the clients that a new image is available
+	if ( callback != NULL )
+		callback(this, userdata);
+}
+
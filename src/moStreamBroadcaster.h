@@ -0,0 +1,98 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_STREAM_BROADCASTER_H
+#define MO_STREAM_BROADCASTER_H
+
+#include <vector>
+#include "pasync.h"
+#include "moModule.h"
+#include "cv.h"
+
+#define MO_STREAM_DEFAULT_QUALITY	80
+
+class moDataStream;
+class moStreamBroadcaster;
+
+typedef void (*moStreamBroadcasterCallback)(moStreamBroadcaster *broadcaster, void *userdata);
+
+/*! \brief Encode the images of a stream to JPEG once, for all the clients
+ *
+ * There is one broadcaster for each (stream, scale, quality), shared by
+ * the clients with acquire() / release(). Each new image is copied and
+ * encoded on the broadcaster thread, and the clients read the same bytes
+ * with getFrame().
+ */
+class moStreamBroadcaster : public moModule {
+public:
+	/*! \brief Get the broadcaster of a stream, create it if needed
+	 */
+	static moStreamBroadcaster *acquire(moDataStream *stream, int scale, int quality);
+
+	/*! \brief Release a broadcaster given by acquire()
+	 */
+	static void release(moStreamBroadcaster *broadcaster);
+
+	/*! \brief Copy the last encoded image if it is newer than sequence
+	 *
+	 * \return true if data and sequence have been updated
+	 */
+	bool getFrame(unsigned int &sequence, std::vector<unsigned char> &data);
+
+	/*! \brief Sequence number of the last encoded image (0 if none)
+	 */
+	unsigned int getSequence();
+
+	/*! \brief Call a function after each encoded image
+	 *
+	 * The callback is called from the broadcaster thread.
+	 */
+	void setCallback(moStreamBroadcasterCallback callback, void *userdata);
+
+	virtual void setInput(moDataStream* stream, int n=0);
+	virtual moDataStream *getInput(int n=0);
+	virtual moDataStream *getOutput(int n=0);
+	virtual void notifyData(moDataStream *source);
+	virtual void update();
+
+	virtual std::string getName() { return "StreamBroadcaster"; }
+	virtual std::string getDescription() { return "Encode a stream to JPEG for the web clients"; }
+	virtual std::string getAuthor() { return "Movid Team"; }
+
+private:
+	moStreamBroadcaster(moDataStream *stream, int scale, int quality);
+	virtual ~moStreamBroadcaster();
+
+	moDataStream *input;
+	int scale;
+	int quality;
+	int references;
+	IplImage *buffer;
+	IplImage *converted;
+
+	// last encoded image, protected by jpeg_mtx
+	std::vector<unsigned char> jpeg;
+	std::vector<unsigned char> encoded;
+	unsigned int sequence;
+	moStreamBroadcasterCallback callback;
+	void *userdata;
+	pt::mutex *jpeg_mtx;
+};
+
+#endif
+
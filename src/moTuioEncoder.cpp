@@ -0,0 +1,244 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#include <assert.h>
+#include <string.h>
+
+#include "moTuioEncoder.h"
+#include "moLog.h"
+
+LOG_DECLARE("TUIO");
+
+// size of "#bundle" + time tag
+#define TUIO_BUNDLE_HEADER		16
+
+moTuioEncoder::moTuioEncoder() {
+	this->mtu = 1472;
+	this->delta = false;
+	this->refresh = 0;
+	this->frame = 0;
+	this->fseq = 0;
+	this->timetag = 0.;
+	this->profile = NULL;
+	this->alive_written = false;
+	this->fseq_size = 0;
+	this->alive_start = 0;
+	this->profile_start = 0;
+	this->packet_count = 0;
+}
+
+moTuioEncoder::~moTuioEncoder() {
+}
+
+void moTuioEncoder::setMTU(unsigned int mtu) {
+	this->mtu = mtu;
+}
+
+void moTuioEncoder::setDelta(bool delta, unsigned int refresh) {
+	this->delta = delta;
+	this->refresh = refresh;
+}
+
+void moTuioEncoder::beginFrame(int fseq, double timetag) {
+	this->fseq = fseq;
+	this->timetag = timetag;
+	this->frame++;
+	this->packet_count = 0;
+	this->profile = NULL;
+}
+
+void moTuioEncoder::beginProfile(const char *address) {
+	std::vector<tuio_profile_t>::iterator it;
+
+	assert( this->profile == NULL );
+
+	for ( it = this->profiles.begin(); it != this->profiles.end(); it++ ) {
+		if ( it->address == address )
+			break;
+	}
+	if ( it == this->profiles.end() ) {
+		this->profiles.push_back(tuio_profile_t());
+		this->profiles.back().address = address;
+		it = this->profiles.end() - 1;
+	}
+
+	this->profile = &(*it);
+	this->alive.clear();
+	this->alive_written = false;
+
+	// size of the fseq message, inside a bundle
+	this->message.clear();
+	this->message.beginMessage(address, "si");
+	this->message.addString("fseq");
+	this->message.addInt(this->fseq);
+	this->fseq_size = this->message.size() + 4;
+}
+
+void moTuioEncoder::addAlive(int session_id) {
+	assert( this->profile != NULL );
+	assert( !this->alive_written );
+	this->alive.push_back(session_id);
+}
+
+moOSCPacket &moTuioEncoder::beginSet(const char *types) {
+	assert( this->profile != NULL );
+	this->types = "s";
+	this->types += types;
+	this->message.clear();
+	this->message.beginMessage(this->profile->address.c_str(), this->types.c_str());
+	this->message.addString("set");
+	return this->message;
+}
+
+void moTuioEncoder::endSet(int session_id) {
+	std::map<int, tuio_session_t>::iterator it;
+	unsigned int mark;
+	bool full;
+
+	assert( this->profile != NULL );
+
+	this->message.endMessage();
+
+	// skip the session if the same set message have already been sent
+	it = this->profile->sessions.find(session_id);
+	if ( it == this->profile->sessions.end() ) {
+		it = this->profile->sessions.insert(
+			std::make_pair(session_id, tuio_session_t())).first;
+	} else {
+		full = this->refresh > 0 && (this->frame % this->refresh) == 0;
+		if ( this->delta && !full
+			&& it->second.message.size() == this->message.size()
+			&& memcmp(it->second.message.data(), this->message.getBuffer(),
+				this->message.size()) == 0 ) {
+			it->second.frame = this->frame;
+			return;
+		}
+	}
+	it->second.message.assign(this->message.getBuffer(), this->message.size());
+	it->second.frame = this->frame;
+
+	if ( !this->alive_written )
+		this->writeAlive();
+
+	mark = this->currentPacket().size();
+	this->currentPacket().addMessage(this->message);
+	if ( this->currentPacket().size() + this->fseq_size <= this->mtu )
+		return;
+
+	if ( mark > this->alive_start ) {
+		// the bundle is full, close it and continue in a new one
+		this->currentPacket().truncate(mark);
+		this->writeFseq();
+	} else if ( this->profile_start > TUIO_BUNDLE_HEADER ) {
+		// first set of the profile, move the whole profile in a new bundle
+		this->currentPacket().truncate(this->profile_start);
+	} else
+		return;
+
+	this->newPacket();
+	this->writeAlive();
+	this->currentPacket().addMessage(this->message);
+}
+
+void moTuioEncoder::endProfile() {
+	std::map<int, tuio_session_t>::iterator it;
+
+	assert( this->profile != NULL );
+
+	if ( !this->alive_written )
+		this->writeAlive();
+	this->writeFseq();
+
+	// forget the sessions that are not alive anymore
+	it = this->profile->sessions.begin();
+	while ( it != this->profile->sessions.end() ) {
+		if ( it->second.frame != this->frame )
+			this->profile->sessions.erase(it++);
+		else
+			it++;
+	}
+
+	this->profile = NULL;
+}
+
+void moTuioEncoder::endFrame() {
+	assert( this->profile == NULL );
+}
+
+unsigned int moTuioEncoder::getPacketCount() {
+	return this->packet_count;
+}
+
+const moOSCPacket &moTuioEncoder::getPacket(unsigned int n) {
+	assert( n < this->packet_count );
+	return this->packets[n];
+}
+
+moOSCPacket &moTuioEncoder::currentPacket() {
+	if ( this->packet_count == 0 )
+		this->newPacket();
+	return this->packets[this->packet_count - 1];
+}
+
+void moTuioEncoder::newPacket() {
+	if ( this->packet_count >= this->packets.size() )
+		this->packets.resize(this->packet_count + 1);
+	this->packets[this->packet_count].beginBundle(this->timetag);
+	this->packet_count++;
+}
+
+void moTuioEncoder::writeAlive() {
+	std::vector<int>::iterator it;
+	moOSCPacket *packet = &this->currentPacket();
+	unsigned int mark = packet->size();
+
+	// type tags depend of the number of sessions
+	this->types = "s";
+	this->types.append(this->alive.size(), 'i');
+	packet->beginMessage(this->profile->address.c_str(), this->types.c_str());
+	packet->addString("alive");
+	for ( it = this->alive.begin(); it != this->alive.end(); it++ )
+		packet->addInt(*it);
+	packet->endMessage();
+
+	// a previous profile is already in the bundle, start a new one
+	if ( packet->size() + this->fseq_size > this->mtu
+		&& mark > TUIO_BUNDLE_HEADER ) {
+		packet->truncate(mark);
+		this->newPacket();
+		this->writeAlive();
+		return;
+	}
+
+	if ( packet->size() + this->fseq_size > this->mtu )
+		LOG(MO_WARNING, "alive message of " << this->profile->address
+			<< " doesn't fit in the MTU (" << this->mtu << ")");
+
+	this->profile_start = mark;
+	this->alive_start = packet->size();
+	this->alive_written = true;
+}
+
+void moTuioEncoder::writeFseq() {
+	moOSCPacket &packet = this->currentPacket();
+	packet.beginMessage(this->profile->address.c_str(), "si");
+	packet.addString("fseq");
+	packet.addInt(this->fseq);
+	packet.endMessage();
+}
+
@@ -0,0 +1,114 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_TUIO_ENCODER_H
+#define MO_TUIO_ENCODER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "moOSCPacket.h"
+
+typedef struct {
+	std::string message;	// last set message sent for this session
+	unsigned int frame;		// last frame where the session was alive
+} tuio_session_t;
+
+typedef struct {
+	std::string address;
+	std::map<int, tuio_session_t> sessions;
+} tuio_profile_t;
+
+/*! \brief Encode TUIO frames into OSC bundles no larger than a MTU
+ *
+ * A frame is made of one or more profiles (/tuio/2Dcur, /tuio/2Dobj...).
+ * For each profile, the caller declare the alive sessions first, then one
+ * set message per session:
+ *
+ *   encoder.beginFrame(fseq);
+ *   encoder.beginProfile("/tuio/2Dcur");
+ *   encoder.addAlive(id); ...
+ *   moOSCPacket &msg = encoder.beginSet("iffffff");
+ *   msg.addInt(id); msg.addFloat(x); ...
+ *   encoder.endSet(id); ...
+ *   encoder.endProfile();
+ *   encoder.endFrame();
+ *
+ * When a bundle would exceed the MTU, it's closed with the fseq message
+ * and the remaining set messages go into a new bundle, starting with the
+ * same alive message, as allowed by the TUIO specification.
+ */
+class moTuioEncoder {
+public:
+	moTuioEncoder();
+	virtual ~moTuioEncoder();
+
+	void setMTU(unsigned int mtu);
+
+	/*! \brief Skip set messages of sessions that didn't change
+	 *
+	 * \param refresh send all the set messages every refresh frames
+	 *                (0 = never)
+	 */
+	void setDelta(bool delta, unsigned int refresh);
+
+	/*! \brief Start a new frame
+	 *
+	 * \param timetag time tag of the bundles, 0 for immediately
+	 */
+	void beginFrame(int fseq, double timetag = 0.);
+	void beginProfile(const char *address);
+	void addAlive(int session_id);
+	moOSCPacket &beginSet(const char *types);
+	void endSet(int session_id);
+	void endProfile();
+	void endFrame();
+
+	unsigned int getPacketCount();
+	const moOSCPacket &getPacket(unsigned int n);
+
+private:
+	unsigned int mtu;
+	bool delta;
+	unsigned int refresh;
+	unsigned int frame;
+	int fseq;
+	double timetag;
+
+	std::vector<tuio_profile_t> profiles;
+	tuio_profile_t *profile;
+	std::vector<int> alive;
+	bool alive_written;
+	unsigned int profile_start;
+	unsigned int alive_start;
+	unsigned int fseq_size;
+
+	// packets are reused from one frame to another
+	std::vector<moOSCPacket> packets;
+	unsigned int packet_count;
+	moOSCPacket message;
+	std::string types;
+
+	moOSCPacket &currentPacket();
+	void newPacket();
+	void writeAlive();
+	void writeFseq();
+};
+
+#endif
+
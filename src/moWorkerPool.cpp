@@ -0,0 +1,100 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#include "moWorkerPool.h"
+#include "moThread.h"
+
+void _worker_thread(moThread *thread) {
+	mo_worker_t *worker = (mo_worker_t *)thread->getUserData();
+	moWorkerPool *pool = worker->pool;
+
+	while ( true ) {
+		worker->start->wait();
+		if ( thread->wantQuit() )
+			break;
+		pool->process(pool->userdata, worker->index, pool->workers.size() + 1);
+		worker->done->post();
+	}
+}
+
+moWorkerPool::moWorkerPool() {
+	this->process = NULL;
+	this->userdata = NULL;
+}
+
+moWorkerPool::~moWorkerPool() {
+	this->clear();
+}
+
+void moWorkerPool::setThreads(int count) {
+	unsigned int i;
+
+	if ( count < 1 )
+		count = 1;
+	if ( (unsigned int)count == this->workers.size() + 1 )
+		return;
+
+	this->clear();
+
+	// the workers addresses are given to the threads, don't move them
+	this->workers.resize(count - 1);
+	for ( i = 0; i < this->workers.size(); i++ ) {
+		this->workers[i].index = i;
+		this->workers[i].pool = this;
+		this->workers[i].start = new pt::trigger(true, false);
+		this->workers[i].done = new pt::trigger(true, false);
+		this->workers[i].thread = new moThread(_worker_thread, &this->workers[i]);
+		this->workers[i].thread->start();
+	}
+}
+
+int moWorkerPool::getThreads() {
+	return this->workers.size() + 1;
+}
+
+void moWorkerPool::run(worker_process_t process, void *userdata) {
+	unsigned int i;
+
+	this->process = process;
+	this->userdata = userdata;
+
+	for ( i = 0; i < this->workers.size(); i++ )
+		this->workers[i].start->post();
+
+	// the last job is done by the calling thread
+	process(userdata, this->workers.size(), this->workers.size() + 1);
+
+	for ( i = 0; i < this->workers.size(); i++ )
+		this->workers[i].done->wait();
+}
+
+void moWorkerPool::clear() {
+	unsigned int i;
+
+	for ( i = 0; i < this->workers.size(); i++ ) {
+		this->workers[i].thread->stop();
+		this->workers[i].start->post();
+		this->workers[i].thread->waitfor();
+		delete this->workers[i].thread;
+		delete this->workers[i].start;
+		delete this->workers[i].done;
+	}
+	this->workers.clear();
+}
+
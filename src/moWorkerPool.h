@@ -0,0 +1,68 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_WORKER_POOL_H
+#define MO_WORKER_POOL_H
+
+#include <vector>
+#include "pasync.h"
+
+class moThread;
+
+typedef void (*worker_process_t)(void *userdata, int index, int count);
+
+typedef struct {
+	moThread *thread;
+	pt::trigger *start;
+	pt::trigger *done;
+	int index;
+	class moWorkerPool *pool;
+} mo_worker_t;
+
+/*! \brief Threads kept around to split the work of a module
+ *
+ * run() calls process(userdata, index, count) once for each index in
+ * [0, count), on the pool threads and on the calling thread, and returns
+ * when all of them are done.
+ */
+class moWorkerPool {
+public:
+	moWorkerPool();
+	virtual ~moWorkerPool();
+
+	/*! \brief Set the number of jobs of run(), including the calling thread
+	 */
+	void setThreads(int count);
+	int getThreads();
+
+	void run(worker_process_t process, void *userdata);
+
+	/*! \brief Stop all the threads
+	 */
+	void clear();
+
+private:
+	std::vector<mo_worker_t> workers;
+	worker_process_t process;
+	void *userdata;
+
+	friend void _worker_thread(moThread *thread);
+};
+
+#endif
+
@@ -22,7 +22,7 @@
 
 MODULE_DECLARE(Amplify, "native", "Amplifies input image (for every pixel: p = p^amp, so larger values get larger quicker");
 
-moAmplifyModule::moAmplifyModule() : moImageFilterModule(){
+moAmplifyModule::moAmplifyModule() : moLutModule(){
 	MODULE_INIT();
 	this->properties["amplification"] = new moProperty(0.2);
 }
@@ -34,3 +34,13 @@ void moAmplifyModule::applyFilter(IplImage *src) {
 	cvMul(src, src, this->output_buffer, this->property("amplification").asDouble());
 }
 
+void moAmplifyModule::buildLut(unsigned char *lut) {
+	// same rounding and saturation than cvMul on 8 bits images
+	float amplification = (float)this->property("amplification").asDouble();
+	int value;
+	for ( int i = 0; i < 256; i++ ) {
+		value = cvRound(amplification * (float)(i * i));
+		lut[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+	}
+}
+
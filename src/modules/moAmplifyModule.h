@@ -19,15 +19,16 @@
 #ifndef MO_AMPLIFY_MODULE_H
 #define MO_AMPLIFY_MODULE_H
 
-#include "moImageFilterModule.h"
+#include "moLutModule.h"
 
-class moAmplifyModule : public moImageFilterModule{
+class moAmplifyModule : public moLutModule{
 public:
 	moAmplifyModule();
 	virtual ~moAmplifyModule();
 	
 protected:
 	void applyFilter(IplImage *);
+	void buildLut(unsigned char *lut);
 	MODULE_INTERNALS();
 };
 
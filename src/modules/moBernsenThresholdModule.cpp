@@ -0,0 +1,140 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+//
+// Local threshold for uneven lighting, from libfidtrack (as in reacTIVision).
+//
+// Each tile of tile_size pixels is thresholded at the middle of the min and
+// max of the surrounding (2 * tile_size) square. Tiles where max - min is
+// under contrast are uniform: they become all white or all black.
+//
+
+#include <assert.h>
+#include "moBernsenThresholdModule.h"
+#include "../moLog.h"
+#include "cv.h"
+
+#include "libfidtrack/tiled_bernsen_threshold.h"
+
+MODULE_DECLARE(BernsenThreshold, "native", "Tiled Bernsen threshold, for uneven lighting");
+
+typedef struct {
+	TiledBernsenThresholder *thresholder;
+	IplImage *src;
+	IplImage *dst;
+	int tile_size;
+	int contrast;
+	bool apply;
+} bernsen_job_t;
+
+// first pass: min/max of blocks, second pass: threshold of tile rows
+static void _bernsen_rows(void *userdata, int index, int count) {
+	bernsen_job_t *job = (bernsen_job_t *)userdata;
+	IplImage *src = job->src;
+	int rows;
+
+	if ( !job->apply ) {
+		rows = tiled_bernsen_block_count(src->height, job->tile_size);
+		tiled_bernsen_min_max(job->thresholder,
+			(const unsigned char *)src->imageData, 1, src->widthStep,
+			src->width, src->height, job->tile_size,
+			rows * index / count, rows * (index + 1) / count);
+	} else {
+		rows = tiled_bernsen_tile_rows(src->height, job->tile_size);
+		tiled_bernsen_apply(job->thresholder,
+			(unsigned char *)job->dst->imageData, job->dst->widthStep,
+			(const unsigned char *)src->imageData, 1, src->widthStep,
+			src->width, src->height, job->tile_size, job->contrast,
+			rows * index / count, rows * (index + 1) / count);
+	}
+}
+
+moBernsenThresholdModule::moBernsenThresholdModule() : moImageFilterModule(){
+
+	MODULE_INIT();
+
+	// declare properties
+	this->properties["tile_size"] = new moProperty(16);
+	this->properties["tile_size"]->setMin(4);
+	this->properties["tile_size"]->setMax(256);
+	this->properties["contrast"] = new moProperty(40);
+	this->properties["contrast"]->setMin(0);
+	this->properties["contrast"]->setMax(255);
+	this->properties["threads"] = new moProperty(1);
+	this->properties["threads"]->setMin(1);
+	this->properties["threads"]->setMax(16);
+
+	this->thresholder = NULL;
+	this->tile_size = 0;
+	this->width = 0;
+	this->height = 0;
+}
+
+moBernsenThresholdModule::~moBernsenThresholdModule() {
+	this->releaseThresholder();
+}
+
+void moBernsenThresholdModule::stop() {
+	this->pool.clear();
+	moImageFilterModule::stop();
+}
+
+void moBernsenThresholdModule::releaseThresholder() {
+	if ( this->thresholder == NULL )
+		return;
+	terminate_tiled_bernsen_thresholder((TiledBernsenThresholder *)this->thresholder);
+	delete (TiledBernsenThresholder *)this->thresholder;
+	this->thresholder = NULL;
+}
+
+void moBernsenThresholdModule::applyFilter(IplImage *src) {
+	bernsen_job_t job;
+
+	if ( src->nChannels != 1 || src->depth != IPL_DEPTH_8U ) {
+		this->setError("BernsenThreshold input image must be a single channel 8 bits image.");
+		this->stop();
+		return;
+	}
+
+	job.tile_size = this->property("tile_size").asInteger();
+	job.contrast = this->property("contrast").asInteger();
+
+	// buffers depend on the image and tile size
+	if ( this->thresholder == NULL || job.tile_size != this->tile_size
+		|| src->width != this->width || src->height != this->height ) {
+		this->releaseThresholder();
+		this->thresholder = new TiledBernsenThresholder;
+		initialize_tiled_bernsen_thresholder((TiledBernsenThresholder *)this->thresholder,
+			src->width, src->height, job.tile_size);
+		this->tile_size = job.tile_size;
+		this->width = src->width;
+		this->height = src->height;
+	}
+
+	job.thresholder = (TiledBernsenThresholder *)this->thresholder;
+	job.src = src;
+	job.dst = this->output_buffer;
+
+	this->pool.setThreads(this->property("threads").asInteger());
+	job.apply = false;
+	this->pool.run(_bernsen_rows, &job);
+	job.apply = true;
+	this->pool.run(_bernsen_rows, &job);
+}
+
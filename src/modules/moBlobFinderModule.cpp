@@ -48,6 +48,8 @@ void moBlobFinderModule::clearBlobs() {
 }
 
 void moBlobFinderModule::applyFilter(IplImage *src) {
+	mo_frame_t data_frame = this->frame;
+	double x, y;
 
 	this->clearBlobs();
 	cvCopy(src, this->output_buffer);
@@ -64,10 +66,14 @@ void moBlobFinderModule::applyFilter(IplImage *src) {
 	while (cur_cont != 0) {
 		CvRect rect	= cvBoundingRect(cur_cont, 0);
 
+		x = (rect.x + rect.width / 2) / (double) src->width;
+		y = (rect.y + rect.height / 2) / (double) src->height;
+		mo_frame_to_source(this->frame, x, y);
+
 		moDataGenericContainer *blob = new moDataGenericContainer();
 		blob->properties["type"] = new moProperty("blob");
-		blob->properties["x"] = new moProperty((rect.x + rect.width / 2) / (double) src->width);
-		blob->properties["y"] = new moProperty((rect.y + rect.height / 2) / (double) src->height);
+		blob->properties["x"] = new moProperty(x);
+		blob->properties["y"] = new moProperty(y);
 		blob->properties["width"] = new moProperty(rect.width);
         blob->properties["height"] = new moProperty(rect.height);
         this->blobs->push_back(blob);
@@ -75,7 +81,9 @@ void moBlobFinderModule::applyFilter(IplImage *src) {
 		cur_cont = cur_cont->h_next;
 	}
 	
-    this->output_data->push(this->blobs);
+	// positions are in the source frame now
+	mo_frame_reset_transform(data_frame);
+	this->output_data->push(this->blobs, data_frame);
 }
 
 moDataStream* moBlobFinderModule::getOutput(int n) {
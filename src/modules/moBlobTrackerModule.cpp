@@ -132,6 +132,8 @@ void moBlobTrackerModule::allocateBuffers() {
 
 void moBlobTrackerModule::applyFilter(IplImage *src) {
 	IplImage* fg_map = NULL;
+	mo_frame_t data_frame = this->frame;
+	double x, y;
 
 	assert( src != NULL );
 	CvSize size = cvGetSize(src);
@@ -169,17 +171,22 @@ void moBlobTrackerModule::applyFilter(IplImage *src) {
 			<< "," << pB->y << "size=" << pB->w << "," << pB->h);
 
 		// add the blob in data
+		x = pB->x / size.width;
+		y = pB->y / size.height;
+		mo_frame_to_source(this->frame, x, y);
 		moDataGenericContainer *touch = new moDataGenericContainer();
 		touch->properties["type"] = new moProperty("blob");
 		touch->properties["id"] = new moProperty(pB->ID);
-		touch->properties["x"] = new moProperty(pB->x / size.width);
-		touch->properties["y"] = new moProperty(pB->y / size.height);
+		touch->properties["x"] = new moProperty(x);
+		touch->properties["y"] = new moProperty(y);
 		touch->properties["w"] = new moProperty(pB->w);
 		touch->properties["h"] = new moProperty(pB->h);
 		this->blobs.push_back(touch);
 	};
 
-	this->output_data->push(&this->blobs);
+	// positions are in the source frame now
+	mo_frame_reset_transform(data_frame);
+	this->output_data->push(&this->blobs, data_frame);
 }
 
 moDataStream* moBlobTrackerModule::getOutput(int n) {
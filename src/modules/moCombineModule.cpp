@@ -16,15 +16,62 @@
  **********************************************************************/
 
 
+//
+// Paint image2 over image1, where the first channel of image2 is not 0.
+// With "sync", the images are combined when both inputs have the same
+// frame, or after "timeout" seconds with the latest ones if "fallback" is
+// "latest". The composite is done in one pass from the input images.
+//
+
 #include <assert.h>
+#include <string.h>
 
 #include "../moLog.h"
 #include "../moModule.h"
 #include "../moDataStream.h"
 #include "moCombineModule.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 MODULE_DECLARE(Combine, "native", "Take the maximum color from 2 image");
 
+// out = fg where the first channel of fg is not 0, else bg
+static void _composite_line(unsigned char *out, const unsigned char *bg,
+							const unsigned char *fg, int width, int channels, int bytes) {
+	int x = 0, pixel = channels * bytes, b;
+	const unsigned char *src;
+
+	if ( pixel == 1 ) {
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128();
+		for ( ; x + 16 <= width; x += 16 ) {
+			__m128i f = _mm_loadu_si128((const __m128i *)(fg + x));
+			__m128i transparent = _mm_cmpeq_epi8(f, zero);
+			__m128i r = _mm_or_si128(
+				_mm_and_si128(transparent, _mm_loadu_si128((const __m128i *)(bg + x))),
+				_mm_andnot_si128(transparent, f));
+			_mm_storeu_si128((__m128i *)(out + x), r);
+		}
+#endif
+		for ( ; x < width; x++ )
+			out[x] = fg[x] ? fg[x] : bg[x];
+		return;
+	}
+
+	for ( ; x < width; x++, out += pixel, bg += pixel, fg += pixel ) {
+		src = bg;
+		for ( b = 0; b < bytes; b++ ) {
+			if ( fg[b] ) {
+				src = fg;
+				break;
+			}
+		}
+		memcpy(out, src, pixel);
+	}
+}
+
 moCombineModule::moCombineModule() : moModule(MO_MODULE_INPUT|MO_MODULE_OUTPUT, 2, 1) {
 	MODULE_INIT();
 
@@ -32,6 +79,13 @@ moCombineModule::moCombineModule() : moModule(MO_MODULE_INPUT|MO_MODULE_OUTPUT,
 	this->input2 = NULL;
 	this->output = new moDataStream("IplImage");
 	this->output_buffer = NULL;
+	this->join.setInputs(2);
+
+	this->properties["sync"] = new moProperty(true);
+	this->properties["timeout"] = new moProperty(0.1);
+	this->properties["timeout"]->setMin(0);
+	this->properties["fallback"] = new moProperty("latest");
+	this->properties["fallback"]->setChoices("latest;skip");
 
 	// declare outputs
 	this->input_infos[0] = new moDataStreamInfo(
@@ -43,6 +97,9 @@ moCombineModule::moCombineModule() : moModule(MO_MODULE_INPUT|MO_MODULE_OUTPUT,
 }
 
 moCombineModule::~moCombineModule() {
+	delete this->output;
+	if ( this->output_buffer != NULL )
+		cvReleaseImage(&this->output_buffer);
 }
 
 void moCombineModule::notifyData(moDataStream *input) {
@@ -53,7 +110,6 @@ void moCombineModule::notifyData(moDataStream *input) {
 
 	if ( this->output_buffer == NULL ) {
 		this->output_buffer = cvCreateImage(cvGetSize(src), src->depth, src->nChannels);
-		this->split = cvCreateImage(cvGetSize(src), src->depth, 1);
 	} else {
 		if ( this->output_buffer->width != src->width ||
 			 this->output_buffer->height != src->height ) {
@@ -61,47 +117,84 @@ void moCombineModule::notifyData(moDataStream *input) {
 		}
 	}
 
-	this->notifyUpdate();
+	if ( this->input2 == NULL || !this->property("sync").asBool() ) {
+		this->notifyUpdate();
+		return;
+	}
+
+	this->join.setTimeout(this->property("timeout").asDouble(),
+		this->property("fallback").asString() == "latest");
+	if ( this->join.notify(input == this->input1 ? 0 : 1, input->getFrame()) )
+		this->notifyUpdate();
+}
+
+void moCombineModule::poll() {
+	// a frame that never complete
+	this->lock();
+	if ( this->input2 != NULL && this->property("sync").asBool() && this->join.expired() )
+		this->notifyUpdate();
+	this->unlock();
+
+	moModule::poll();
 }
 
 void moCombineModule::update() {
 	IplImage *d1 = NULL, *d2 = NULL;
+	mo_frame_t frame;
+	bool valid = true;
+	int y;
+
 	if ( this->input1 == NULL || this->output_buffer == NULL )
 		return;
 
+	// the inputs are locked during the composite, nothing is cloned
 	this->input1->lock();
 	d1 = (IplImage *)this->input1->getData();
+	frame = this->input1->getFrame();
 	if ( d1 == NULL ) {
 		this->input1->unlock();
 		return;
 	}
 
-	d1 = cvCloneImage(d1);
-	this->input1->unlock();
-
 	if ( this->input2 == NULL ) {
 		cvCopy(d1, this->output_buffer);
-	} else {
+		this->input1->unlock();
+		this->output->push(this->output_buffer, frame);
+		return;
+	}
+
+	// the same stream can be connected twice
+	if ( this->input2 != this->input1 )
 		this->input2->lock();
-		d2 = (IplImage *)this->input2->getData();
-		if ( d2 == NULL ) {
-			this->input2->unlock();
-			cvReleaseImage(&d1);
-			return;
-		}
+	d2 = (IplImage *)this->input2->getData();
+	if ( d2 == NULL
+		 || d1->width != this->output_buffer->width || d1->height != this->output_buffer->height
+		 || d2->width != d1->width || d2->height != d1->height
+		 || d2->depth != d1->depth || d2->nChannels != d1->nChannels
+		 || this->output_buffer->depth != d1->depth
+		 || this->output_buffer->nChannels != d1->nChannels )
+		valid = false;
+
+	if ( valid ) {
+		for ( y = 0; y < d1->height; y++ )
+			_composite_line(
+				(unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep,
+				(const unsigned char *)d1->imageData + y * d1->widthStep,
+				(const unsigned char *)d2->imageData + y * d2->widthStep,
+				d1->width, d1->nChannels, (d1->depth & 0xff) / 8);
+	}
 
-		d2 = cvCloneImage(d2);
+	if ( this->input2 != this->input1 )
 		this->input2->unlock();
+	this->input1->unlock();
 
-		cvSplit(d2, this->split, NULL, NULL, NULL);
-		cvCopy(d1, this->output_buffer);
-		cvCopy(d2, this->output_buffer, this->split);
+	if ( !valid ) {
+		if ( d2 != NULL )
+			this->setError("Combine images must have the same size and format");
+		return;
 	}
 
-	this->output->push(this->output_buffer);
-
-	cvReleaseImage(&d1);
-	cvReleaseImage(&d2);
+	this->output->push(this->output_buffer, frame);
 }
 
 void moCombineModule::setInput(moDataStream *stream, int n) {
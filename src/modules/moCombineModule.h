@@ -20,6 +20,7 @@
 #define MO_COMBINE_H
 
 #include "../moModule.h"
+#include "../moFrameJoin.h"
 #include "cv.h"
 
 class moDataStream;
@@ -33,6 +34,7 @@ public:
 	virtual moDataStream *getInput(int n=0);
 	virtual moDataStream *getOutput(int n=0);
 	virtual void notifyData(moDataStream *input);
+	virtual void poll();
 
 	void update();
 
@@ -41,7 +43,7 @@ private:
 	moDataStream *input2;
 	moDataStream *output;
 	IplImage *output_buffer;
-	IplImage *split;
+	moFrameJoin join;
 
 	MODULE_INTERNALS();
 };
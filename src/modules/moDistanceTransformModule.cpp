@@ -16,9 +16,26 @@
  **********************************************************************/
 
 
+//
+// The default "exact" mode computes the euclidean distance of each non zero
+// pixel to the closest zero pixel in linear time (Felzenszwalb and
+// Huttenlocher): the vertical distances first, then for each line the lower
+// envelope of the parabolas they make. Columns, then lines, are split
+// between "threads" threads. The "opencv" mode use cvDistTransform with
+// metric and mask_size.
+//
+// Output 1 is the distance in pixels (32 bits float). The scaled 8 bits
+// image of output 0 is only made if something is connected to it.
+//
+// The distances are written in two images in turn: a module holding the
+// output 1 lock can read the pushed one, the next frame goes in the other
+// one, and the push after it waits for the lock.
+//
+
 #include <map>
 #include <utility>
 #include <assert.h>
+#include <math.h>
 #include "moDistanceTransformModule.h"
 #include "../moLog.h"
 #include "cv.h"
@@ -26,14 +43,131 @@
 
 MODULE_DECLARE(DistanceTransform, "native", "Assign each pixel a color representing pixel's distance to the closest contour.");
 
+typedef struct {
+	IplImage *src;
+	IplImage *dist;
+	IplImage *preview;
+	int *envelope;
+	float *bounds;
+	float *squares;
+	float scale;
+	int pass;
+} distance_job_t;
+
+// pass 0: distance to the closest zero pixel in the column, split by columns
+static void _distance_columns(distance_job_t *job, int first, int end) {
+	IplImage *src = job->src;
+	float infinite = (float)(src->width + src->height);
+	const unsigned char *pixels;
+	float *line, *above;
+	int x, y;
+
+	for ( y = 0; y < src->height; y++ ) {
+		pixels = (const unsigned char *)src->imageData + y * src->widthStep;
+		line = (float *)(job->dist->imageData + y * job->dist->widthStep);
+		if ( y == 0 ) {
+			for ( x = first; x < end; x++ )
+				line[x] = pixels[x] ? infinite : 0.f;
+			continue;
+		}
+		above = (float *)((char *)line - job->dist->widthStep);
+		for ( x = first; x < end; x++ )
+			line[x] = pixels[x] ? above[x] + 1.f : 0.f;
+	}
+
+	for ( y = src->height - 2; y >= 0; y-- ) {
+		line = (float *)(job->dist->imageData + y * job->dist->widthStep);
+		above = (float *)((char *)line + job->dist->widthStep);
+		for ( x = first; x < end; x++ )
+			if ( above[x] + 1.f < line[x] )
+				line[x] = above[x] + 1.f;
+	}
+}
+
+// pass 1: lower envelope of the parabolas (x - q)^2 + column(q)^2 on each
+// line, split by rows
+static void _distance_lines(distance_job_t *job, int index, int first, int end) {
+	int width = job->src->width;
+	int *v = job->envelope + index * width;
+	float *z = job->bounds + index * (width + 1);
+	float *f = job->squares + index * width;
+	unsigned char *out = NULL;
+	float *line, s, d;
+	int x, y, k;
+
+	for ( y = first; y < end; y++ ) {
+		line = (float *)(job->dist->imageData + y * job->dist->widthStep);
+		for ( x = 0; x < width; x++ )
+			f[x] = line[x] * line[x];
+
+		k = 0;
+		v[0] = 0;
+		z[0] = -HUGE_VAL;
+		z[1] = HUGE_VAL;
+		for ( x = 1; x < width; x++ ) {
+			s = ((f[x] + x * x) - (f[v[k]] + v[k] * v[k])) / (2 * (x - v[k]));
+			while ( s <= z[k] ) {
+				k--;
+				s = ((f[x] + x * x) - (f[v[k]] + v[k] * v[k])) / (2 * (x - v[k]));
+			}
+			k++;
+			v[k] = x;
+			z[k] = s;
+			z[k + 1] = HUGE_VAL;
+		}
+
+		if ( job->preview != NULL )
+			out = (unsigned char *)job->preview->imageData + y * job->preview->widthStep;
+
+		k = 0;
+		for ( x = 0; x < width; x++ ) {
+			while ( z[k + 1] < x )
+				k++;
+			d = sqrtf((x - v[k]) * (x - v[k]) + f[v[k]]);
+			line[x] = d;
+			if ( out != NULL ) {
+				d = d * job->scale + 0.5f;
+				out[x] = d >= 255.f ? 255 : (unsigned char)d;
+			}
+		}
+	}
+}
+
+static void _distance_pass(void *userdata, int index, int count) {
+	distance_job_t *job = (distance_job_t *)userdata;
+	int size;
+
+	if ( job->pass == 0 ) {
+		size = job->src->width;
+		_distance_columns(job, size * index / count, size * (index + 1) / count);
+		return;
+	}
+
+	size = job->src->height;
+	_distance_lines(job, index, size * index / count, size * (index + 1) / count);
+}
+
 moDistanceTransformModule::moDistanceTransformModule() : moImageFilterModule(){
 
 	MODULE_INIT();
 
+	this->converted = NULL;
+	this->dists[0] = this->dists[1] = NULL;
+	this->dist = NULL;
+
+	this->output_distance = new moDataStream("IplImage");
+	this->output_count = 2;
+	this->output_infos[1] = new moDataStreamInfo("distance", "IplImage", "Distance in pixels (32 bits float image)");
+
 	// The factor by which the resulting image is scaled (for visibility)
 	this->properties["scale"] = new moProperty(5);
 	this->properties["scale"]->setMin(1);
 	this->properties["scale"]->setMax(255);
+	this->properties["mode"] = new moProperty("exact");
+	this->properties["mode"]->setChoices("exact;opencv");
+	this->properties["threads"] = new moProperty(1);
+	this->properties["threads"]->setMin(1);
+	this->properties["threads"]->setMax(16);
 	this->properties["mask_size"] = new moProperty("5");
 	this->properties["mask_size"]->setChoices("3;5;Precise");
 	this->properties["metric"] = new moProperty("L2");
@@ -41,6 +175,24 @@ moDistanceTransformModule::moDistanceTransformModule() : moImageFilterModule(){
 }
 
 moDistanceTransformModule::~moDistanceTransformModule() {
+	this->releaseDistances();
+	delete this->output_distance;
+}
+
+void moDistanceTransformModule::stop() {
+	this->pool.clear();
+	moImageFilterModule::stop();
+	this->releaseDistances();
+}
+
+void moDistanceTransformModule::releaseDistances() {
+	if ( this->converted != NULL )
+		cvReleaseImage(&this->converted);
+	for ( int i = 0; i < 2; i++ ) {
+		if ( this->dists[i] != NULL )
+			cvReleaseImage(&this->dists[i]);
+	}
+	this->dist = NULL;
 }
 
 void moDistanceTransformModule::allocateBuffers() {
@@ -50,12 +202,20 @@ void moDistanceTransformModule::allocateBuffers() {
 	// Formats required by cvDistTransform:
 	// Converted version of the input img
 	this->converted = cvCreateImage(cvGetSize(src), IPL_DEPTH_8U, 1);
-	// The img that will contain the actual distances
-	this->dist = cvCreateImage(cvGetSize(src), IPL_DEPTH_32F, 1);
+	// The imgs that will contain the actual distances
+	this->dists[0] = cvCreateImage(cvGetSize(src), IPL_DEPTH_32F, 1);
+	this->dists[1] = cvCreateImage(cvGetSize(src), IPL_DEPTH_32F, 1);
+	this->dist = this->dists[0];
 	this->output_buffer = cvCreateImage(cvGetSize(src), IPL_DEPTH_8U, 1);
 	LOG(MO_DEBUG, "allocated output buffer for DistanceTransform module.");
 }
 
+moDataStream* moDistanceTransformModule::getOutput(int n) {
+	if ( n == 1 )
+		return this->output_distance;
+	return moImageFilterModule::getOutput(n);
+}
+
 int moDistanceTransformModule::toCvType(const std::string &metric) {
 	if ( metric == "L2" )
 		return CV_DIST_L2;
@@ -84,17 +244,59 @@ int moDistanceTransformModule::toCvMaskSize(const std::string &mask_size) {
 	return 0;
 }
 
+void moDistanceTransformModule::exactTransform(IplImage *src, bool preview) {
+	distance_job_t job;
+	int threads = this->property("threads").asInteger();
+
+	this->pool.setThreads(threads);
+	threads = this->pool.getThreads();
+	if ( this->envelope.size() != (unsigned int)(threads * src->width) ) {
+		this->envelope.resize(threads * src->width);
+		this->bounds.resize(threads * (src->width + 1));
+		this->squares.resize(threads * src->width);
+	}
+
+	job.src = src;
+	job.dist = this->dist;
+	job.preview = preview ? this->output_buffer : NULL;
+	job.envelope = &this->envelope[0];
+	job.bounds = &this->bounds[0];
+	job.squares = &this->squares[0];
+	job.scale = (float)this->property("scale").asInteger();
+
+	for ( job.pass = 0; job.pass < 2; job.pass++ )
+		this->pool.run(_distance_pass, &job);
+}
+
 void moDistanceTransformModule::applyFilter(IplImage *src) {
-	cvConvertImage(src, this->converted);
-
-	cvDistTransform(
-			 this->converted,
-			 this->dist,
-			 this->toCvType(this->property("metric").asString()),
-			 this->toCvMaskSize(this->property("mask_size").asString())
-			 );
-	// In order to actually see something in the output, we have to scale the
-	// result for visibility.
-	cvConvertScale(this->dist, this->output_buffer,
-				   this->property("scale").asInteger(), 0);
+	bool preview = this->output->getObserverCount() > 0;
+
+	// not the image pushed for the previous frame
+	this->dist = this->dist == this->dists[0] ? this->dists[1] : this->dists[0];
+
+	// the exact transform read 8 bits single channel images directly
+	if ( src->depth != IPL_DEPTH_8U || src->nChannels != 1
+		 || this->property("mode").asString() != "exact" ) {
+		cvConvertImage(src, this->converted);
+		src = this->converted;
+	}
+
+	if ( this->property("mode").asString() == "exact" ) {
+		this->exactTransform(src, preview);
+	} else {
+		cvDistTransform(
+				 src,
+				 this->dist,
+				 this->toCvType(this->property("metric").asString()),
+				 this->toCvMaskSize(this->property("mask_size").asString())
+				 );
+		// In order to actually see something in the output, we have to scale the
+		// result for visibility.
+		if ( preview )
+			cvConvertScale(this->dist, this->output_buffer,
+						   this->property("scale").asInteger(), 0);
+	}
+
+	this->output_distance->push(this->dist, this->frame);
 }
+
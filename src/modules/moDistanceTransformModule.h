@@ -19,21 +19,37 @@
 #ifndef MO_DISTANCETRANSFORM_MODULE_H
 #define MO_DISTANCETRANSFORM_MODULE_H
 
+#include <vector>
 #include "moImageFilterModule.h"
+#include "../moWorkerPool.h"
 
 class moDistanceTransformModule : public moImageFilterModule{
 public:
 	moDistanceTransformModule();
 	virtual ~moDistanceTransformModule();
 
+	virtual moDataStream *getOutput(int n=0);
+	virtual void stop();
+
 protected:
 	void applyFilter(IplImage*);
 	void allocateBuffers();
 	int toCvType(const std::string&);
 	int toCvMaskSize(const std::string&);
+	void exactTransform(IplImage *src, bool preview);
+	void releaseDistances();
 	int width, height;
 	IplImage* converted;
+	// distances, the one pushed and the one being written
+	IplImage* dists[2];
 	IplImage* dist;
+	moDataStream *output_distance;
+
+	// lower envelope of the parabolas, for each thread
+	std::vector<int> envelope;
+	std::vector<float> bounds;
+	std::vector<float> squares;
+	moWorkerPool pool;
 
 	MODULE_INTERNALS();
 };
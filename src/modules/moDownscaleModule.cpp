@@ -0,0 +1,133 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+//
+// Reduce an 8 bits image by 2 or 4, each output pixel is the mean of the
+// factor x factor pixels it cover. Used to detect on a small image, then
+// Refine the blobs on the full image.
+//
+
+#include <assert.h>
+#include <string.h>
+#include "moDownscaleModule.h"
+#include "../moLog.h"
+#include "cv.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+MODULE_DECLARE(Downscale, "native", "Reduce the image size by 2 or 4 (area average)");
+
+// add a line of pixels to the column sums
+static void _accumulate_line(unsigned short *sums, const unsigned char *line, int count) {
+	int x = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; x + 16 <= count; x += 16 ) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(line + x));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sums + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(sums + x + 8));
+		lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+		hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(sums + x), lo);
+		_mm_storeu_si128((__m128i *)(sums + x + 8), hi);
+	}
+#endif
+	for ( ; x < count; x++ )
+		sums[x] += line[x];
+}
+
+moDownscaleModule::moDownscaleModule() : moImageFilterModule(){
+
+	MODULE_INIT();
+
+	this->properties["factor"] = new moProperty(2);
+	this->properties["factor"]->setChoices("2;4");
+}
+
+moDownscaleModule::~moDownscaleModule() {
+}
+
+void moDownscaleModule::allocateBuffers() {
+	IplImage* src = static_cast<IplImage*>(this->input->getData());
+	int factor = this->property("factor").asInteger();
+	if ( src == NULL )
+		return;
+	if ( factor != 2 && factor != 4 )
+		factor = 2;
+	this->output_buffer = cvCreateImage(cvSize(src->width / factor, src->height / factor),
+		src->depth, src->nChannels);
+	LOGM(MO_DEBUG, "allocated " << this->output_buffer->width << "x"
+		<< this->output_buffer->height << " output buffer");
+}
+
+void moDownscaleModule::applyFilter(IplImage *src) {
+	int factor = this->property("factor").asInteger();
+	int channels = src->nChannels;
+	int x, y, k, c, sum, row, area, half;
+	unsigned short *column;
+	unsigned char *out;
+
+	if ( src->depth != IPL_DEPTH_8U ) {
+		this->setError("Downscale input image must be a 8 bits image.");
+		this->stop();
+		return;
+	}
+
+	if ( factor != 2 && factor != 4 ) {
+		this->setError("Downscale factor must be 2 or 4");
+		return;
+	}
+
+	// factor have been changed
+	if ( this->output_buffer->width != src->width / factor ||
+		 this->output_buffer->height != src->height / factor ) {
+		cvReleaseImage(&this->output_buffer);
+		this->allocateBuffers();
+	}
+
+	row = this->output_buffer->width * factor * channels;
+	area = factor * factor;
+	half = area / 2;
+	if ( this->sums.size() != (unsigned int)row )
+		this->sums.resize(row);
+
+	for ( y = 0; y < this->output_buffer->height; y++ ) {
+		// vertical sums, 16 pixels at a time
+		memset(&this->sums[0], 0, row * sizeof(unsigned short));
+		for ( k = 0; k < factor; k++ )
+			_accumulate_line(&this->sums[0],
+				(const unsigned char *)src->imageData + (y * factor + k) * src->widthStep, row);
+
+		// then the horizontal ones
+		out = (unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep;
+		column = &this->sums[0];
+		for ( x = 0; x < this->output_buffer->width; x++ ) {
+			for ( c = 0; c < channels; c++ ) {
+				sum = 0;
+				for ( k = 0; k < factor; k++ )
+					sum += column[k * channels + c];
+				*out++ = (unsigned char)((sum + half) / area);
+			}
+			column += factor * channels;
+		}
+	}
+}
+
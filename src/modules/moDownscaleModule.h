@@ -0,0 +1,42 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#ifndef MO_DOWNSCALE_MODULE_H
+#define MO_DOWNSCALE_MODULE_H
+
+#include <vector>
+#include "moImageFilterModule.h"
+
+class moDownscaleModule : public moImageFilterModule{
+public:
+	moDownscaleModule();
+	virtual ~moDownscaleModule();
+
+protected:
+	void applyFilter(IplImage *);
+	void allocateBuffers();
+
+	// sum of factor lines, for each column
+	std::vector<unsigned short> sums;
+
+	MODULE_INTERNALS();
+};
+
+#endif
+
@@ -18,7 +18,41 @@
 
 // check reactivision
 // check http://www.openframeworks.cc/forum/viewtopic.php?t=486&highlight=fiducial
+//
+// With roi, only windows of roi_size pixels around the fiducials of the
+// previous frame are segmented. The whole frame is still scanned every
+// full_scan frames, when a fiducial is lost, or when there is nothing to
+// track, to pick up new fiducials.
+//
+// Fiducials found within session_distance pixels of the same fiducial on
+// the previous frame keep their session_id, with or without roi.
+//
+// For testing, verify checks the threaded scan against a single thread
+// scan on that many full scans, then finishes the module (movid -t).
+//
+// Lens distortion is corrected in the libfidtrack distortion map, built
+// once (and again when a calibration property change): fiducials
+// positions and angles come out undistorted at no cost per frame. Windows
+// and drawings use the position in the camera image, before correction. Use
+// either the k1, k2, k3 (radial) and p1, p2 (tangential) coefficients with
+// the camera matrix fx, fy, cx, cy in pixels (0 means image width for
+// fx/fy, and image center for cx/cy), as given by OpenCV calibration, or a
+// grid file:
+//
+//   cols rows
+//   x y      (cols + 1) * (rows + 1) times, row by row
+//
+// where x y is the undistorted position (normalized) of the grid point
+// regularly spaced on the camera image.
+//
+// With threads > 1, the rows of the full frame are scanned by several
+// threads, then the regions are linked on the module thread. The result is
+// exactly the same as with a single thread.
+//
+#include <math.h>
 #include <stdlib.h>
+#include <fstream>
+#include <string.h>
 #include <assert.h>
 #include "moFiducialTrackerModule.h"
 #include "../moLog.h"
@@ -40,8 +74,54 @@ typedef struct {
 	TreeIdMap treeidmap;
 	FidtrackerX fidtrackerx;
 	ShortPoint *dmap;
+
+	// window search, allocated for roi_size
+	int roi_size;
+	Segmenter roi_segmenter;
+	FidtrackerX roi_fidtrackerx;
+	ShortPoint *roi_dmap;
+	unsigned char *roi_image;
 } fiducials_data_t;
 
+typedef struct {
+	Segmenter *segmenter;
+	const unsigned char *source;
+	int height;
+} fiducial_strips_t;
+
+// dmap points are shorts, keep far away points out of the frame
+static short _dmap_value(double value) {
+	if ( value < -32768. ) return -32768;
+	if ( value > 32767. ) return 32767;
+	return (short)floor(value + 0.5);
+}
+
+// libfidtrack angle is atan2(dy, dx) - pi/2, mirror it like the position
+static double _frame_angle(const mo_frame_t &frame, double angle) {
+	double dx = -sin(angle), dy = cos(angle);
+	if ( frame.transform[0] >= 0. && frame.transform[4] >= 0. )
+		return angle;
+	if ( frame.transform[0] < 0. )
+		dx = -dx;
+	if ( frame.transform[4] < 0. )
+		dy = -dy;
+	angle = atan2(dy, dx) - M_PI * .5;
+	if ( angle < 0. )
+		angle += 2. * M_PI;
+	return angle;
+}
+
+static void _dmap_changed_cb(moProperty *property, void *userdata) {
+	moFiducialTrackerModule *module = static_cast<moFiducialTrackerModule *>(userdata);
+	module->dmap_changed = true;
+}
+
+static void _segment_strip(void *userdata, int index, int count) {
+	fiducial_strips_t *strips = (fiducial_strips_t *)userdata;
+	find_segmenter_runs(strips->segmenter, strips->source,
+		strips->height * index / count, strips->height * (index + 1) / count);
+}
+
 moFiducialTrackerModule::moFiducialTrackerModule() : moImageFilterModule() {
 	MODULE_INIT();
 
@@ -50,11 +130,57 @@ moFiducialTrackerModule::moFiducialTrackerModule() : moImageFilterModule() {
 	this->output_infos[1] = new moDataStreamInfo("data", "GenericFiducial", "Data stream with fiducial info");
 
 	this->internal = malloc(sizeof(fiducials_data_t));
+	memset(this->internal, 0, sizeof(fiducials_data_t));
+
+	this->session_counter = 0;
+	this->frame_count = 0;
+	this->verified = 0;
+
+	this->properties["roi"] = new moProperty(false);
+	this->properties["roi_size"] = new moProperty(128);
+	this->properties["roi_size"]->setMin(16);
+	this->properties["full_scan"] = new moProperty(30);
+	this->properties["full_scan"]->setMin(1);
+	this->properties["threads"] = new moProperty(1);
+	this->properties["threads"]->setMin(1);
+	this->properties["threads"]->setMax(16);
+	this->properties["session_distance"] = new moProperty(64.);
+	this->properties["session_distance"]->setMin(0);
+	this->properties["verify"] = new moProperty(0);
+	this->properties["verify"]->setMin(0);
+
+	this->properties["grid"] = new moProperty("");
+	this->properties["k1"] = new moProperty(0.);
+	this->properties["k2"] = new moProperty(0.);
+	this->properties["k3"] = new moProperty(0.);
+	this->properties["p1"] = new moProperty(0.);
+	this->properties["p2"] = new moProperty(0.);
+	this->properties["fx"] = new moProperty(0.);
+	this->properties["fy"] = new moProperty(0.);
+	this->properties["cx"] = new moProperty(0.);
+	this->properties["cy"] = new moProperty(0.);
+	this->properties["fx"]->setMin(0);
+	this->properties["fy"]->setMin(0);
+	this->properties["cx"]->setMin(0);
+	this->properties["cy"]->setMin(0);
+
+	const char *calibration[] = { "grid", "k1", "k2", "k3", "p1", "p2", "fx", "fy", "cx", "cy" };
+	for ( unsigned int i = 0; i < sizeof(calibration) / sizeof(calibration[0]); i++ )
+		this->properties[calibration[i]]->addCallback(_dmap_changed_cb, this);
+
+	this->grid_cols = 0;
+	this->grid_rows = 0;
+	this->dmap_changed = false;
 }
 
 moFiducialTrackerModule::~moFiducialTrackerModule() {
 }
 
+void moFiducialTrackerModule::stop() {
+	this->pool.clear();
+	moImageFilterModule::stop();
+}
+
 void moFiducialTrackerModule::clearFiducials() {
 	moDataGenericList::iterator it;
 	for ( it = this->fiducials.begin(); it != this->fiducials.end(); it++ )
@@ -74,23 +200,284 @@ void moFiducialTrackerModule::allocateBuffers() {
 	initialize_treeidmap( &fids->treeidmap );
 
 	fids->dmap = new ShortPoint[src->height*src->width];
-	for ( int y = 0; y < src->height; y++ ) {
-		for ( int x = 0; x < src->width; x++ ) {
-			fids->dmap[y*src->width+x].x = x;
-			fids->dmap[y*src->width+x].y = y;
-		}
-	}
+	this->buildDistortionMap(src->width, src->height);
 
 	initialize_fidtrackerX( &fids->fidtrackerx, &fids->treeidmap, fids->dmap);
 	initialize_segmenter( &fids->segmenter, src->width, src->height, fids->treeidmap.max_adjacencies );
 }
 
+bool moFiducialTrackerModule::loadGrid() {
+	std::string filename = this->property("grid").asString();
+	int i, count;
+
+	this->grid.clear();
+	this->grid_cols = this->grid_rows = 0;
+	if ( filename == "" )
+		return false;
+
+	std::ifstream f(filename.c_str());
+	if ( !f.is_open() ) {
+		LOGM(MO_ERROR, "unable to open calibration grid <" << filename << ">");
+		this->setError("unable to open calibration grid");
+		return false;
+	}
+
+	f >> this->grid_cols >> this->grid_rows;
+	if ( f.fail() || this->grid_cols <= 0 || this->grid_rows <= 0 ) {
+		LOGM(MO_ERROR, "invalid calibration grid size in <" << filename << ">");
+		this->setError("invalid calibration grid");
+		this->grid_cols = this->grid_rows = 0;
+		return false;
+	}
+
+	count = (this->grid_cols + 1) * (this->grid_rows + 1) * 2;
+	this->grid.resize(count);
+	for ( i = 0; i < count; i++ )
+		f >> this->grid[i];
+	if ( f.fail() ) {
+		LOGM(MO_ERROR, "calibration grid <" << filename << "> is too short");
+		this->setError("invalid calibration grid");
+		this->grid.clear();
+		this->grid_cols = this->grid_rows = 0;
+		return false;
+	}
+
+	return true;
+}
+
+// fill dmap with the undistorted position of each camera pixel
+void moFiducialTrackerModule::buildDistortionMap(int width, int height) {
+	fiducials_data_t *fids = (fiducials_data_t *)this->internal;
+	ShortPoint *p = fids->dmap;
+	double k1, k2, k3, p1, p2, fx, fy, cx, cy;
+	double gx, gy, tx, ty, xd, yd, x, y, r2, radial, dx, dy;
+	double *g00, *g10, *g01, *g11;
+	int i, j, px, py, iter, stride;
+
+	this->dmap_changed = false;
+	if ( p == NULL )
+		return;
+
+	k1 = this->property("k1").asDouble();
+	k2 = this->property("k2").asDouble();
+	k3 = this->property("k3").asDouble();
+	p1 = this->property("p1").asDouble();
+	p2 = this->property("p2").asDouble();
+	fx = this->property("fx").asDouble();
+	fy = this->property("fy").asDouble();
+	cx = this->property("cx").asDouble();
+	cy = this->property("cy").asDouble();
+	if ( fx <= 0 ) fx = width;
+	if ( fy <= 0 ) fy = width;
+	if ( cx <= 0 ) cx = width * 0.5;
+	if ( cy <= 0 ) cy = height * 0.5;
+
+	if ( this->loadGrid() ) {
+		LOGM(MO_INFO, "use calibration grid " << this->grid_cols << "x" << this->grid_rows);
+		stride = (this->grid_cols + 1) * 2;
+		for ( py = 0; py < height; py++ ) {
+			gy = (double)py * this->grid_rows / height;
+			j = (int)gy;
+			ty = gy - j;
+			for ( px = 0; px < width; px++, p++ ) {
+				gx = (double)px * this->grid_cols / width;
+				i = (int)gx;
+				tx = gx - i;
+
+				// bilinear interpolation between the 4 surrounding points
+				g00 = &this->grid[j * stride + i * 2];
+				g10 = g00 + 2;
+				g01 = g00 + stride;
+				g11 = g01 + 2;
+				x = (1 - ty) * ((1 - tx) * g00[0] + tx * g10[0]) + ty * ((1 - tx) * g01[0] + tx * g11[0]);
+				y = (1 - ty) * ((1 - tx) * g00[1] + tx * g10[1]) + ty * ((1 - tx) * g01[1] + tx * g11[1]);
+				p->x = _dmap_value(x * width);
+				p->y = _dmap_value(y * height);
+			}
+		}
+		return;
+	}
+
+	if ( k1 == 0 && k2 == 0 && k3 == 0 && p1 == 0 && p2 == 0 ) {
+		for ( py = 0; py < height; py++ ) {
+			for ( px = 0; px < width; px++, p++ ) {
+				p->x = px;
+				p->y = py;
+			}
+		}
+		return;
+	}
+
+	LOGM(MO_INFO, "use lens calibration k1=" << k1 << " k2=" << k2 << " k3=" << k3
+		<< " p1=" << p1 << " p2=" << p2);
+
+	// the model gives the distorted position of an undistorted point,
+	// invert it by fixed point iteration (as cvUndistortPoints)
+	for ( py = 0; py < height; py++ ) {
+		for ( px = 0; px < width; px++, p++ ) {
+			xd = x = (px - cx) / fx;
+			yd = y = (py - cy) / fy;
+			for ( iter = 0; iter < 10; iter++ ) {
+				r2 = x * x + y * y;
+				radial = 1 + ((k3 * r2 + k2) * r2 + k1) * r2;
+				dx = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+				dy = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+				x = (xd - dx) / radial;
+				y = (yd - dy) / radial;
+			}
+			p->x = _dmap_value(x * fx + cx);
+			p->y = _dmap_value(y * fy + cy);
+		}
+	}
+}
+
+void moFiducialTrackerModule::allocateWindow(int size) {
+	fiducials_data_t *fids = (fiducials_data_t *)this->internal;
+
+	if ( fids->roi_size == size )
+		return;
+
+	if ( fids->roi_size > 0 ) {
+		terminate_segmenter(&fids->roi_segmenter);
+		terminate_fidtrackerX(&fids->roi_fidtrackerx);
+		delete [] fids->roi_dmap;
+		delete [] fids->roi_image;
+	}
+
+	// the window dmap is refilled from the frame dmap for each window,
+	// so the fiducials positions come out in frame coordinates
+	fids->roi_size = size;
+	fids->roi_dmap = new ShortPoint[size * size];
+	fids->roi_image = new unsigned char[size * size];
+	initialize_fidtrackerX(&fids->roi_fidtrackerx, &fids->treeidmap, fids->roi_dmap);
+	initialize_segmenter(&fids->roi_segmenter, size, size, fids->treeidmap.max_adjacencies);
+}
+
+void moFiducialTrackerModule::windowOrigin(const fiducial_track_t &track, IplImage *src, int *ox, int *oy) {
+	int size = ((fiducials_data_t *)this->internal)->roi_size;
+
+	// windows are cut in the camera image, and kept inside the frame
+	*ox = (int)track.raw_x - size / 2;
+	*oy = (int)track.raw_y - size / 2;
+	if ( *ox < 0 ) *ox = 0;
+	if ( *oy < 0 ) *oy = 0;
+	if ( *ox > src->width - size ) *ox = src->width - size;
+	if ( *oy > src->height - size ) *oy = src->height - size;
+}
+
+void moFiducialTrackerModule::segment(IplImage *src) {
+	fiducials_data_t *fids = (fiducials_data_t *)this->internal;
+	fiducial_strips_t strips;
+
+	this->pool.setThreads(this->property("threads").asInteger());
+	if ( this->pool.getThreads() == 1 ) {
+		step_segmenter(&fids->segmenter, (const unsigned char *)src->imageData);
+		return;
+	}
+
+	strips.segmenter = &fids->segmenter;
+	strips.source = (const unsigned char *)src->imageData;
+	strips.height = src->height;
+	this->pool.run(_segment_strip, &strips);
+
+	link_segmenter_runs(&fids->segmenter, strips.source);
+}
+
+int moFiducialTrackerModule::searchFull(IplImage *src) {
+	fiducials_data_t *fids = (fiducials_data_t *)this->internal;
+	std::vector<FiducialX> threaded;
+	int i, count;
+
+	this->segment(src);
+	count = find_fiducialsX(fids->fiducials, MAX_FIDUCIALS,
+			&fids->fidtrackerx, &fids->segmenter, src->width, src->height);
+
+	if ( this->verified >= this->property("verify").asInteger() )
+		return count;
+
+	// scan again in one thread, the fiducials must be the same
+	if ( this->pool.getThreads() > 1 ) {
+		threaded.assign(fids->fiducials, fids->fiducials + count);
+		step_segmenter(&fids->segmenter, (const unsigned char *)src->imageData);
+		count = find_fiducialsX(fids->fiducials, MAX_FIDUCIALS,
+				&fids->fidtrackerx, &fids->segmenter, src->width, src->height);
+
+		for ( i = 0; i < count && i < (int)threaded.size(); i++ ) {
+			if ( threaded[i].id != fids->fiducials[i].id
+				|| threaded[i].x != fids->fiducials[i].x
+				|| threaded[i].y != fids->fiducials[i].y
+				|| threaded[i].angle != fids->fiducials[i].angle )
+				break;
+		}
+		if ( i < count || count != (int)threaded.size() ) {
+			LOGM(MO_ERROR, "threaded scan found " << threaded.size() << " fiducials, "
+				<< count << " in one thread, first difference at " << i);
+			this->setError("threaded scan differs from the single thread scan");
+		}
+	}
+
+	this->verified++;
+	if ( this->verified >= this->property("verify").asInteger() ) {
+		LOGM(MO_INFO, "threaded scan verified on " << this->verified << " frames");
+		this->setFinished();
+	}
+
+	return count;
+}
+
+// return the number of fiducials found, or -1 if a fiducial have been lost
+int moFiducialTrackerModule::searchWindows(IplImage *src) {
+	fiducials_data_t *fids = (fiducials_data_t *)this->internal;
+	std::vector<fiducial_track_t>::iterator it;
+	int size = fids->roi_size;
+	int ox, oy, y, i, n, count = 0;
+	bool found;
+
+	for ( it = this->tracks.begin(); it != this->tracks.end(); it++ ) {
+		if ( count >= MAX_FIDUCIALS )
+			break;
+
+		this->windowOrigin(*it, src, &ox, &oy);
+		for ( y = 0; y < size; y++ ) {
+			memcpy(&fids->roi_image[y * size],
+				&src->imageData[(oy + y) * src->widthStep + ox], size);
+			memcpy(&fids->roi_dmap[y * size],
+				&fids->dmap[(oy + y) * src->width + ox], size * sizeof(ShortPoint));
+		}
+
+		step_segmenter(&fids->roi_segmenter, fids->roi_image);
+		n = find_fiducialsX(&fids->fiducials[count], MAX_FIDUCIALS - count,
+			&fids->roi_fidtrackerx, &fids->roi_segmenter, size, size);
+
+		// the tracked fiducial must still be in its window
+		found = false;
+		for ( i = count; i < count + n; i++ ) {
+			fids->fiducials[i].raw_x += ox;
+			fids->fiducials[i].raw_y += oy;
+			if ( fids->fiducials[i].id == it->id )
+				found = true;
+		}
+		if ( !found )
+			return -1;
+
+		count += n;
+	}
+
+	return count;
+}
+
 void moFiducialTrackerModule::applyFilter(IplImage *src) {
 	fiducials_data_t *fids = static_cast<fiducials_data_t*>(this->internal);
+	std::vector<fiducial_track_t>::iterator it, best;
 	moDataGenericContainer *fiducial;
+	fiducial_track_t track;
 	FiducialX *fdx;
 	int fid_count, valid_fiducials = 0;
+	int roi_size, ox, oy, j;
+	double dist, best_dist, session_distance, x, y;
+	mo_frame_t data_frame = this->frame;
 	bool do_image = this->output->getObserverCount() > 0 ? true : false;
+	bool full;
 	CvSize size = cvGetSize(src);
 
 	CvFont font, font2;
@@ -112,13 +499,38 @@ void moFiducialTrackerModule::applyFilter(IplImage *src) {
 	if ( do_image )
 		cvSet(this->output_buffer, CV_RGB(0, 0, 0));
 
+	if ( this->dmap_changed )
+		this->buildDistortionMap(src->width, src->height);
+
 	// libfidtrack
-	step_segmenter(&fids->segmenter, (const unsigned char*)src->imageData);
-	fid_count = find_fiducialsX(fids->fiducials, MAX_FIDUCIALS,
-			&fids->fidtrackerx, &fids->segmenter, src->width, src->height);
+	roi_size = this->property("roi_size").asInteger();
+	session_distance = this->property("session_distance").asDouble();
+	full = !this->property("roi").asBool()
+		|| this->tracks.empty()
+		|| roi_size > src->width || roi_size > src->height
+		|| (this->frame_count % this->property("full_scan").asInteger()) == 0;
+	this->frame_count++;
+
+	fid_count = -1;
+	if ( !full ) {
+		this->allocateWindow(roi_size);
+		fid_count = this->searchWindows(src);
+		if ( fid_count < 0 ) {
+			LOGM(MO_DEBUG, "fiducial lost, scan the whole frame");
+		} else if ( do_image ) {
+			for ( it = this->tracks.begin(); it != this->tracks.end(); it++ ) {
+				this->windowOrigin(*it, src, &ox, &oy);
+				cvRectangle(this->output_buffer, cvPoint(ox, oy),
+					cvPoint(ox + roi_size - 1, oy + roi_size - 1), CV_RGB(0, 0, 255));
+			}
+		}
+	}
+	if ( fid_count < 0 )
+		fid_count = this->searchFull(src);
 
 	// prepare to refill fiducials
 	this->clearFiducials();
+	this->current.clear();
 
 	for ( int i = 0; i < fid_count; i++ ) {
 		fdx = &fids->fiducials[i];
@@ -127,18 +539,58 @@ void moFiducialTrackerModule::applyFilter(IplImage *src) {
 		if ( fdx->id < 0 )
 			continue;
 
+		// overlapping windows can find the same fiducial twice
+		for ( j = 0; j < (int)this->current.size(); j++ ) {
+			if ( this->current[j].id == fdx->id &&
+				 fabs(this->current[j].x - fdx->x) < 2. &&
+				 fabs(this->current[j].y - fdx->y) < 2. )
+				break;
+		}
+		if ( j < (int)this->current.size() )
+			continue;
+
+		// keep the session of the nearest fiducial with the same id
+		best = this->tracks.end();
+		best_dist = session_distance * session_distance;
+		for ( it = this->tracks.begin(); it != this->tracks.end(); it++ ) {
+			if ( it->id != fdx->id )
+				continue;
+			dist = (it->x - fdx->x) * (it->x - fdx->x) + (it->y - fdx->y) * (it->y - fdx->y);
+			if ( dist < best_dist ) {
+				best_dist = dist;
+				best = it;
+			}
+		}
+
+		if ( best != this->tracks.end() ) {
+			track.session_id = best->session_id;
+			this->tracks.erase(best);
+		} else
+			track.session_id = this->session_counter++;
+		track.id = fdx->id;
+		track.x = fdx->x;
+		track.y = fdx->y;
+		track.raw_x = fdx->raw_x;
+		track.raw_y = fdx->raw_y;
+		this->current.push_back(track);
+
 		// got a valid fiducial ! process...
 		valid_fiducials++;
 
 		LOGM(MO_DEBUG, "fid:" << i << " id=" << fdx->id << " pos=" \
 			<< fdx->x << "," << fdx->y << " angle=" << fdx->angle);
 
+		x = fdx->x / size.width;
+		y = fdx->y / size.height;
+		mo_frame_to_source(this->frame, x, y);
+
 		fiducial = new moDataGenericContainer();
 		fiducial->properties["type"] = new moProperty("fiducial");
 		fiducial->properties["id"] = new moProperty(fdx->id);
-		fiducial->properties["x"] = new moProperty(fdx->x / size.width);
-		fiducial->properties["y"] = new moProperty(fdx->y / size.height);
-		fiducial->properties["angle"] = new moProperty(fdx->angle);
+		fiducial->properties["session_id"] = new moProperty(track.session_id);
+		fiducial->properties["x"] = new moProperty(x);
+		fiducial->properties["y"] = new moProperty(y);
+		fiducial->properties["angle"] = new moProperty(_frame_angle(this->frame, fdx->angle));
 		fiducial->properties["leaf_size"] = new moProperty(fdx->leaf_size);
 		fiducial->properties["root_size"] = new moProperty(fdx->root_size);
 		this->fiducials.push_back(fiducial);
@@ -148,23 +600,27 @@ void moFiducialTrackerModule::applyFilter(IplImage *src) {
 			std::ostringstream oss;
 			oss << fdx->id;
 			cvPutText(this->output_buffer, oss.str().c_str(),
-				cvPoint(fdx->x, fdx->y - 20), &font, cvScalar(20, 255, 20));
+				cvPoint(fdx->raw_x, fdx->raw_y - 20), &font, cvScalar(20, 255, 20));
 
 			oss.str("");
 			oss << "angle:" << int(fdx->angle * 180 / 3.14159265);
 			cvPutText(this->output_buffer, oss.str().c_str(),
-				cvPoint(fdx->x - 30, fdx->y), &font2, cvScalar(20, 255, 20));
+				cvPoint(fdx->raw_x - 30, fdx->raw_y), &font2, cvScalar(20, 255, 20));
 
 			oss.str("");
 			oss << "l/r:" << fdx->leaf_size << "/" << fdx->root_size;
 			cvPutText(this->output_buffer, oss.str().c_str(),
-				cvPoint(fdx->x - 50, fdx->y + 20), &font2, cvScalar(20, 255, 20));
+				cvPoint(fdx->raw_x - 50, fdx->raw_y + 20), &font2, cvScalar(20, 255, 20));
 
 		}
 	}
 
+	this->tracks.swap(this->current);
+
 	LOGM(MO_DEBUG, "-> Found " << valid_fiducials << " fiducials");
-	this->output_data->push(&this->fiducials);
+	// positions are in the source frame now
+	mo_frame_reset_transform(data_frame);
+	this->output_data->push(&this->fiducials, data_frame);
 }
 
 moDataStream* moFiducialTrackerModule::getOutput(int n) {
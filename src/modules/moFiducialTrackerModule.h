@@ -19,14 +19,29 @@
 #ifndef MO_FIDUCIAL_TRACKER_MODULE_H
 #define MO_FIDUCIAL_TRACKER_MODULE_H
 
+#include <vector>
 #include "../moDataGenericContainer.h"
 #include "moImageFilterModule.h"
+#include "../moWorkerPool.h"
+
+typedef struct {
+	int session_id;
+	int id;
+	double x;
+	double y;
+	// position in the camera image (distorted), for the windows
+	double raw_x;
+	double raw_y;
+} fiducial_track_t;
 
 class moFiducialTrackerModule : public moImageFilterModule {
 public:
 	moFiducialTrackerModule();
 	virtual ~moFiducialTrackerModule();
 	virtual moDataStream *getOutput(int n=0);
+	virtual void stop();
+
+	bool dmap_changed;
 	
 protected:
 	moDataGenericList fiducials;
@@ -35,9 +50,33 @@ protected:
 	void applyFilter(IplImage*);
 	void allocateBuffers();
 	void clearFiducials();
+	void segment(IplImage *src);
+	int searchFull(IplImage *src);
+	int searchWindows(IplImage *src);
+	void allocateWindow(int size);
+	void buildDistortionMap(int width, int height);
+	bool loadGrid();
+	void windowOrigin(const fiducial_track_t &track, IplImage *src, int *ox, int *oy);
 
 	void *internal;
 
+	// fiducials found on the previous frame
+	std::vector<fiducial_track_t> tracks;
+	std::vector<fiducial_track_t> current;
+	int session_counter;
+	unsigned int frame_count;
+
+	// full scans checked against a single thread scan
+	int verified;
+
+	// threads scanning strips of the frame
+	moWorkerPool pool;
+
+	// calibration grid: (grid_cols + 1) * (grid_rows + 1) points
+	std::vector<double> grid;
+	int grid_cols;
+	int grid_rows;
+
 	MODULE_INTERNALS();
 };
 
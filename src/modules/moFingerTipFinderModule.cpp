@@ -16,147 +16,376 @@
  **********************************************************************/
 
 /*
- * This module can be used to detect a hand in an image.
- * The output is binary image showing the hand's outline, the fingertips (as
- * white circles) and the center of the hand (white rectangle).
+ * This module can be used to detect hands in an image.
+ * The output is binary image showing the hands' outline, the fingertips (as
+ * white circles) and the center of the palms (white rectangle). It is only
+ * drawn if something is connected to it. The hands and fingertips are
+ * published as blobs on output 1.
  * The following steps are performed:
- *		1. The contours of the segmented hand are found.
- *		   If the area of the contour is not above a certain threshold, the
- *		   contour can be discarded.
- *		2. The convex hull of the contour is determined and convexity defects
- *		   calculated. The defects that are more than a given threshold
- *		   away from the convex hull are considered. Their start and endpoint
- *		   is interpreted as fingertips.
+ *		1. The exterior contours of the segmented hands are found (the hand
+ *		   has to be white). A contour whose bounding box is smaller than
+ *		   min_area is discarded without more work, then the ones whose area
+ *		   is below min_area. The "hands" biggest ones are kept.
+ *		2. For each hand, the convex hull of the contour is determined and
+ *		   convexity defects calculated. The defects that are more than a
+ *		   given threshold away from the convex hull are considered. Their
+ *		   start and endpoint is interpreted as fingertips.
  *		   Since there are 5 fingers visible at max, we consider only the
  *		   strongest defects, of which we only take 5 at a max. (1 def = 2 points)
  *		3. Since there could (should) be double-detections of the index, middle
  *		   and ring finger, we merge fingertips that are in very close proximity
  *		   of each other.
+ *		Step 2 and 3 are done for several hands at once by "threads" threads.
+ *		4. The center of the palm is the farthest point from the hand border,
+ *		   read on the distance image of input 1 (DistanceTransform output 1)
+ *		   if it is from the same frame, else the centroid of the contour.
+ *		   It is read under the stream lock: DistanceTransform writes the
+ *		   next frame in another image, and waits for the lock to push it.
+ *		   When input 1 is connected, the module wait for both images of a
+ *		   frame, at most "timeout" seconds.
  */
 
 
+#include <math.h>
 #include <assert.h>
+#include <algorithm>
 #include "moFingerTipFinderModule.h"
 #include "../moLog.h"
 #include "cv.h"
 
-// XXX This is currently rather the scratchspace for a fingertip finder...
 MODULE_DECLARE(FingerTipFinder, "native", "Module capable of detecting hands in an image. Detection is based on color-segmentation, contour-shape and distance transform. Finds fingertips & centerpoint of the palm.");
 
 typedef std::pair<float, CvConvexityDefect*> depthToDefect;
 
+typedef struct {
+	moFingerTipFinderModule *module;
+	std::vector<fingertip_hand_t> *hands;
+	std::vector<CvMemStorage *> *storages;
+	double min_distance;
+	double merge_distance;
+} fingertip_job_t;
+
+static bool _sort_pred(const depthToDefect &left, const depthToDefect &right) {
+	return left.first > right.first;
+}
+
+static bool _sort_hands(const fingertip_hand_t &left, const fingertip_hand_t &right) {
+	return left.area > right.area;
+}
+
+static void _find_tips(void *userdata, int index, int count) {
+	fingertip_job_t *job = (fingertip_job_t *)userdata;
+	int size = job->hands->size();
+
+	for ( int i = size * index / count; i < size * (index + 1) / count; i++ )
+		job->module->findTips((*job->hands)[i], (*job->storages)[index],
+			job->min_distance, job->merge_distance);
+}
+
 moFingerTipFinderModule::moFingerTipFinderModule() : moImageFilterModule(){
 
 	MODULE_INIT();
 
 	this->storage = cvCreateMemStorage(0);
+	this->input_distance = NULL;
 	this->properties["min_distance"] = new moProperty(20.);
 	this->properties["min_area"] = new moProperty(150.);
 	this->properties["merge_distance"] = new moProperty(10.);
+	this->properties["hands"] = new moProperty(1);
+	this->properties["hands"]->setMin(1);
+	this->properties["hands"]->setMax(16);
+	this->properties["threads"] = new moProperty(1);
+	this->properties["threads"]->setMin(1);
+	this->properties["threads"]->setMax(16);
+	this->properties["timeout"] = new moProperty(0.1);
+	this->properties["timeout"]->setMin(0);
+
+	this->join.setInputs(2);
+	this->input_count = 2;
+	this->input_infos[1] = new moDataStreamInfo("distance", "IplImage", "Distance image of the hands (optional, 32 bits float)");
+	this->output_data = new moDataStream("GenericBlob");
+	this->output_count = 2;
+	this->output_infos[1] = new moDataStreamInfo("data", "GenericBlob", "Hands and fingertips");
+	this->blobs = new moDataGenericList();
 }
 
 moFingerTipFinderModule::~moFingerTipFinderModule() {
+	this->pool.clear();
+	for ( unsigned int i = 0; i < this->hand_storages.size(); i++ )
+		cvReleaseMemStorage(&this->hand_storages[i]);
 	cvReleaseMemStorage(&this->storage);
+	this->clearBlobs();
+	delete this->blobs;
+	delete this->output_data;
 }
 
-bool _sort_pred(const depthToDefect &left, const depthToDefect &right) {
-	return left.first > right.first;
+void moFingerTipFinderModule::stop() {
+	this->pool.clear();
+	moImageFilterModule::stop();
 }
 
-bool _in2(std::vector<int> &vec, int e) {
-	for (unsigned int i = 0; i < vec.size(); i++) {
-		if (vec[i] == e) return true;
+void moFingerTipFinderModule::setInput(moDataStream *stream, int n) {
+	if ( n != 1 ) {
+		moImageFilterModule::setInput(stream, n);
+		return;
+	}
+
+	if ( this->input_distance != NULL )
+		this->input_distance->removeObserver(this);
+	this->input_distance = stream;
+	if ( stream != NULL && stream->getFormat() != "IplImage" ) {
+		this->setError("Input 1 accept only IplImage");
+		this->input_distance = NULL;
+		return;
 	}
-	return false;
+	if ( stream != NULL )
+		stream->addObserver(this);
 }
 
-void moFingerTipFinderModule::applyFilter(IplImage *src) {
-	// Create a copy since cvFindContours will manipulate its input
-	cvCopy(src, this->output_buffer);
-	CvSeq *contours = 0;
-	cvFindContours(this->output_buffer, this->storage, &contours, sizeof(CvContour), CV_RETR_CCOMP);
-	cvZero(this->output_buffer);
-	if(contours) {
-		// Find the exterior contour (i.e. the hand has to be white) that has the greatest area
-		CvSeq *max_cont = contours, *cur_cont = contours;
-		double area, max_area = 0;
-		while (cur_cont != 0) {
-			area = cvContourArea(cur_cont);
-			area *= area;
-			if (area >= max_area) {
-				max_area = area;
-				max_cont = cur_cont;
-			}
-			cur_cont = cur_cont->h_next;
-		}
+moDataStream *moFingerTipFinderModule::getInput(int n) {
+	if ( n == 1 )
+		return this->input_distance;
+	return moImageFilterModule::getInput(n);
+}
+
+moDataStream *moFingerTipFinderModule::getOutput(int n) {
+	if ( n == 1 )
+		return this->output_data;
+	return moImageFilterModule::getOutput(n);
+}
+
+void moFingerTipFinderModule::notifyData(moDataStream *source) {
+	if ( this->input_distance == NULL ) {
+		moImageFilterModule::notifyData(source);
+		return;
+	}
+
+	// wait for the image and the distance of the same frame
+	this->join.setTimeout(this->property("timeout").asDouble(), true);
+	if ( this->join.notify(source == this->input ? 0 : 1, source->getFrame()) )
+		moImageFilterModule::notifyData(this->input);
+}
+
+void moFingerTipFinderModule::clearBlobs() {
+	moDataGenericList::iterator it;
+	for ( it = this->blobs->begin(); it != this->blobs->end(); it++ )
+		delete (*it);
+	this->blobs->clear();
+}
+
+void moFingerTipFinderModule::findHands(IplImage *src) {
+	double min_area = this->property("min_area").asDouble();
+	unsigned int max_hands = this->property("hands").asInteger();
+	CvSeq *contours = NULL, *cur_cont;
+	CvMoments moments;
+	CvRect rect;
+	fingertip_hand_t hand;
+
+	// the contours of the previous frame are not needed anymore
+	cvClearMemStorage(this->storage);
+	this->hands.clear();
+
+	// src is our own copy of the image, cvFindContours can manipulate it
+	cvFindContours(src, this->storage, &contours, sizeof(CvContour), CV_RETR_EXTERNAL);
+
+	for ( cur_cont = contours; cur_cont != NULL; cur_cont = cur_cont->h_next ) {
+		// the bounding box is computed by cvFindContours, and is never
+		// smaller than the contour
+		rect = ((CvContour *)cur_cont)->rect;
+		if ( (double)rect.width * rect.height < min_area )
+			continue;
+
+		cvMoments(cur_cont, &moments);
+		hand.area = fabs(moments.m00);
 		// Ignore contours whose area is too small, they're likely not hands anyway
-		if (max_area < this->property("min_area").asDouble())
-			return;
-		contours = max_cont;
-
-		cvDrawContours(this->output_buffer, contours, cvScalarAll(255), cvScalarAll(255), 100);
-
-		// Compute the convex hull of the contour
-		CvSeq* hull = 0;
-		hull = cvConvexHull2(contours, contours->storage, CV_CLOCKWISE, 0);
-
-		// Compute the convexity defects of the convex contour with respect to the convex hull.
-		// The fingertips are at the start and endpoints of the defects
-		CvSeq* defects = 0;
-		defects = cvConvexityDefects(contours, hull, contours->storage);
-
-		// Sort the defects based on their distance from the convex hull
-		std::vector<depthToDefect> def_depths;
-		for(int i=0; i < defects->total; ++i) {
-			CvConvexityDefect* defect = (CvConvexityDefect*)cvGetSeqElem (defects, i);
-			def_depths.push_back(depthToDefect(defect->depth, defect));
-		}
-		std::sort(def_depths.begin(), def_depths.end(), _sort_pred);
-
-		// Find the start and end points of the 5 best defects
-		std::vector<CvPoint*> points;
-		for (unsigned int i=0; i < def_depths.size(); i++) {
-			// 5 Fingers max
-			if (i == 5)
-				break;
-			float depth = def_depths[i].first;
-			double min_dist = this->property("min_distance").asDouble();
-			if (min_dist > depth)
-				continue;
-			CvConvexityDefect *defect = def_depths[i].second;
-			points.push_back(defect->start);
-			points.push_back(defect->end);
+		if ( hand.area < min_area || moments.m00 == 0 )
+			continue;
+
+		hand.contour = cur_cont;
+		hand.palm = cvPoint2D32f(moments.m10 / moments.m00, moments.m01 / moments.m00);
+		hand.radius = 0.f;
+		this->hands.push_back(hand);
+	}
+
+	if ( this->hands.size() > max_hands ) {
+		std::partial_sort(this->hands.begin(), this->hands.begin() + max_hands,
+						  this->hands.end(), _sort_hands);
+		this->hands.resize(max_hands);
+	}
+}
+
+void moFingerTipFinderModule::findTips(fingertip_hand_t &hand, CvMemStorage *storage,
+									   double min_dist, double merge_distance) {
+	std::vector<depthToDefect> def_depths;
+	std::vector<CvPoint> points;
+	std::vector<bool> suppressed;
+	unsigned int i, j, count;
+	int dx, dy;
+
+	hand.tips.clear();
+	cvClearMemStorage(storage);
+
+	// Compute the convex hull of the contour
+	CvSeq *hull = cvConvexHull2(hand.contour, storage, CV_CLOCKWISE, 0);
+
+	// Compute the convexity defects of the convex contour with respect to the convex hull.
+	// The fingertips are at the start and endpoints of the defects
+	CvSeq *defects = cvConvexityDefects(hand.contour, hull, storage);
+
+	// Keep the 5 deepest defects (5 fingers max)
+	for ( i = 0; i < (unsigned int)defects->total; i++ ) {
+		CvConvexityDefect *defect = (CvConvexityDefect *)cvGetSeqElem(defects, i);
+		if ( defect->depth < min_dist )
+			continue;
+		def_depths.push_back(depthToDefect(defect->depth, defect));
+	}
+	count = std::min((unsigned int)def_depths.size(), 5U);
+	std::partial_sort(def_depths.begin(), def_depths.begin() + count, def_depths.end(), _sort_pred);
+
+	for ( i = 0; i < count; i++ ) {
+		points.push_back(*def_depths[i].second->start);
+		points.push_back(*def_depths[i].second->end);
+	}
+
+	// Merge almost coinciding points
+	suppressed.assign(points.size(), false);
+	for ( i = 0; i < points.size(); i++ ) {
+		if ( suppressed[i] )
+			continue;
+		for ( j = i + 1; j < points.size(); j++ ) {
+			dx = points[i].x - points[j].x;
+			dy = points[i].y - points[j].y;
+			if ( dx * dx + dy * dy <= merge_distance * merge_distance )
+				suppressed[j] = true;
 		}
+		hand.tips.push_back(points[i]);
+	}
+}
+
+void moFingerTipFinderModule::findPalms() {
+	IplImage *dist;
+	CvRect rect;
+	float *line, best;
+	int x, y;
+
+	if ( this->input_distance == NULL )
+		return;
+
+	this->input_distance->lock();
+	dist = static_cast<IplImage *>(this->input_distance->getData());
+	if ( dist == NULL || dist->depth != IPL_DEPTH_32F || dist->nChannels != 1
+		 || dist->width != this->output_buffer->width
+		 || dist->height != this->output_buffer->height
+		 || this->input_distance->getFrame().id != this->frame.id ) {
+		this->input_distance->unlock();
+		return;
+	}
 
-		// Merge almost coinciding points
-		double distance;
-		double merge_distance = this->property("merge_distance").asDouble();
-		CvPoint *p1, *p2;
-		std::vector<int> suppressed;
-		for (unsigned int i = 0; i < points.size(); i++) {
-			p1 = points[i];
-			for (unsigned int j = i+1; j < points.size(); j++) {
-				if (i == j) continue;
-				if (_in2(suppressed, j)) continue;
-				p2 = points[j];
-				distance = sqrt(pow(p1->x - p2->x, 2.0) + pow(p1->y - p2->y, 2.0));
-				if (distance <= merge_distance) {
-					suppressed.push_back(j);
-				}
+	// the farthest point from the border inside the bounding box
+	for ( unsigned int i = 0; i < this->hands.size(); i++ ) {
+		rect = ((CvContour *)this->hands[i].contour)->rect;
+		best = 0.f;
+		for ( y = rect.y; y < rect.y + rect.height; y++ ) {
+			line = (float *)(dist->imageData + y * dist->widthStep);
+			for ( x = rect.x; x < rect.x + rect.width; x++ ) {
+				if ( line[x] <= best )
+					continue;
+				best = line[x];
+				this->hands[i].palm = cvPoint2D32f(x, y);
 			}
 		}
-		std::vector<CvPoint*> good_points;
-		for (unsigned int i = 0; i < points.size(); i++) {
-			if (!_in2(suppressed, i)) good_points.push_back(points[i]);
-		}
+		this->hands[i].radius = best;
+	}
+
+	this->input_distance->unlock();
+}
 
-		// Draw the points
-		CvPoint *p;
-		for (unsigned int i = 0; i < good_points.size(); i++) {
-			p = good_points[i];
-			int radius = cvRound(10);
-			cvCircle(this->output_buffer, *p, radius, CV_RGB(255, 255, 255), -1);
+void moFingerTipFinderModule::drawHands() {
+	int radius;
+
+	cvZero(this->output_buffer);
+	for ( unsigned int i = 0; i < this->hands.size(); i++ ) {
+		fingertip_hand_t &hand = this->hands[i];
+		cvDrawContours(this->output_buffer, hand.contour, cvScalarAll(255), cvScalarAll(255), 0);
+		for ( unsigned int j = 0; j < hand.tips.size(); j++ )
+			cvCircle(this->output_buffer, hand.tips[j], 10, CV_RGB(255, 255, 255), -1);
+		radius = hand.radius > 5.f ? cvRound(hand.radius) : 5;
+		cvRectangle(this->output_buffer,
+			cvPoint(cvRound(hand.palm.x) - radius, cvRound(hand.palm.y) - radius),
+			cvPoint(cvRound(hand.palm.x) + radius, cvRound(hand.palm.y) + radius),
+			CV_RGB(255, 255, 255));
+	}
+}
+
+void moFingerTipFinderModule::pushHands(IplImage *src) {
+	mo_frame_t data_frame = this->frame;
+	moDataGenericContainer *blob;
+	CvRect rect;
+	double x, y;
+
+	this->clearBlobs();
+	for ( unsigned int i = 0; i < this->hands.size(); i++ ) {
+		fingertip_hand_t &hand = this->hands[i];
+		rect = ((CvContour *)hand.contour)->rect;
+
+		x = hand.palm.x / (double)src->width;
+		y = hand.palm.y / (double)src->height;
+		mo_frame_to_source(this->frame, x, y);
+		blob = new moDataGenericContainer();
+		blob->properties["type"] = new moProperty("hand");
+		blob->properties["hand"] = new moProperty((int)i);
+		blob->properties["x"] = new moProperty(x);
+		blob->properties["y"] = new moProperty(y);
+		blob->properties["width"] = new moProperty(rect.width);
+		blob->properties["height"] = new moProperty(rect.height);
+		blob->properties["radius"] = new moProperty((double)hand.radius);
+		blob->properties["fingers"] = new moProperty((int)hand.tips.size());
+		this->blobs->push_back(blob);
+
+		for ( unsigned int j = 0; j < hand.tips.size(); j++ ) {
+			x = hand.tips[j].x / (double)src->width;
+			y = hand.tips[j].y / (double)src->height;
+			mo_frame_to_source(this->frame, x, y);
+			blob = new moDataGenericContainer();
+			blob->properties["type"] = new moProperty("fingertip");
+			blob->properties["hand"] = new moProperty((int)i);
+			blob->properties["x"] = new moProperty(x);
+			blob->properties["y"] = new moProperty(y);
+			this->blobs->push_back(blob);
 		}
 	}
+
+	// positions are in the source frame now
+	mo_frame_reset_transform(data_frame);
+	this->output_data->push(this->blobs, data_frame);
+}
+
+void moFingerTipFinderModule::applyFilter(IplImage *src) {
+	fingertip_job_t job;
+	unsigned int i;
+
+	if ( src->depth != IPL_DEPTH_8U || src->nChannels != 1 ) {
+		this->setError("FingerTipFinder input image must be a single channel binary image.");
+		this->stop();
+		return;
+	}
+
+	this->findHands(src);
+
+	this->pool.setThreads(this->property("threads").asInteger());
+	for ( i = this->hand_storages.size(); i < (unsigned int)this->pool.getThreads(); i++ )
+		this->hand_storages.push_back(cvCreateMemStorage(0));
+
+	job.module = this;
+	job.hands = &this->hands;
+	job.storages = &this->hand_storages;
+	job.min_distance = this->property("min_distance").asDouble();
+	job.merge_distance = this->property("merge_distance").asDouble();
+	this->pool.run(_find_tips, &job);
+
+	this->findPalms();
+	if ( this->output->getObserverCount() > 0 )
+		this->drawHands();
+	this->pushHands(src);
 }
 
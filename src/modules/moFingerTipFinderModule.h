@@ -19,16 +19,52 @@
 #ifndef UMO_FINGERTIPFINDER_MODULE_H
 #define UMO_FINGERTIPFINDER_MODULE_H
 
+#include <vector>
 #include "moImageFilterModule.h"
+#include "../moDataGenericContainer.h"
+#include "../moWorkerPool.h"
+#include "../moFrameJoin.h"
+
+typedef struct {
+	CvSeq *contour;
+	double area;
+	// center of the palm and its radius (0 without distance input)
+	CvPoint2D32f palm;
+	float radius;
+	std::vector<CvPoint> tips;
+} fingertip_hand_t;
 
 class moFingerTipFinderModule : public moImageFilterModule{
 public:
 	moFingerTipFinderModule();
 	virtual ~moFingerTipFinderModule();
 
+	virtual void setInput(moDataStream* stream, int n=0);
+	virtual moDataStream *getInput(int n=0);
+	virtual moDataStream *getOutput(int n=0);
+	virtual void notifyData(moDataStream *source);
+	virtual void stop();
+
+	void findTips(fingertip_hand_t &hand, CvMemStorage *storage,
+				  double min_distance, double merge_distance);
+
 protected:
 	CvMemStorage *storage;
+	// one for each thread, for the hulls and defects
+	std::vector<CvMemStorage *> hand_storages;
+	std::vector<fingertip_hand_t> hands;
+	moDataStream *input_distance;
+	moDataStream *output_data;
+	moDataGenericList *blobs;
+	moWorkerPool pool;
+	moFrameJoin join;
+
 	void applyFilter(IplImage*);
+	void findHands(IplImage *src);
+	void findPalms();
+	void drawHands();
+	void pushHands(IplImage *src);
+	void clearBlobs();
 
 	MODULE_INTERNALS();
 };
@@ -16,11 +16,107 @@
  **********************************************************************/
 
 
+//
+// Greedy blob tracker
+//
+// New blobs are matched against the blobs of the previous frame, and
+// against blobs lost for less than max_age frames. Candidates are bucketed
+// in a uniform grid of max_dist cells, so that only the 3x3 neighbour cells
+// are searched for each new blob.
+//
+// Two assignment strategies are available :
+//  greedy  : closest pairs first, in increasing distance order
+//  optimal : minimal sum of squared distances (hungarian algorithm), solved
+//            independently for each group of blobs that compete for the
+//            same candidates
+//
+// Each track run an alpha-beta filter that estimate its velocity (vx, vy)
+// and acceleration (accel), in normalized units per second. Candidates are
+// searched at their predicted position. If predict is set, the published
+// positions are extrapolated by the latency between the capture of the
+// frame and the tracker output (capped to predict_max seconds).
+//
+
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <algorithm>
 #include "moGreedyBlobTrackerModule.h"
 #include "../moLog.h"
+#include "../moUtils.h"
 
 MODULE_DECLARE(GreedyBlobTracker, "native", "Track Blobs based on a simple greedy algorithm");
 
+static void _set_property(moDataGenericContainer *blob, const std::string &name, double value) {
+	if ( blob->exist(name) )
+		delete blob->properties[name];
+	blob->properties[name] = new moProperty(value);
+}
+
+static bool _pair_dist_pred(const greedy_pair_t &a, const greedy_pair_t &b) {
+	return a.dist < b.dist;
+}
+
+static bool _pair_group_pred(const greedy_pair_t &a, const greedy_pair_t &b) {
+	if ( a.group != b.group )
+		return a.group < b.group;
+	return a.dist < b.dist;
+}
+
+// Hungarian algorithm (shortest augmenting path version), rows <= cols.
+// cost is a rows x cols matrix, result receive the column of each row.
+static void _solve_assignment(const std::vector<double> &cost, int rows, int cols,
+							  std::vector<int> &result) {
+	std::vector<double> u(rows + 1, 0.), v(cols + 1, 0.), minv(cols + 1);
+	std::vector<int> p(cols + 1, 0), way(cols + 1, 0);
+	std::vector<bool> used(cols + 1);
+
+	assert( rows <= cols );
+
+	for ( int i = 1; i <= rows; i++ ) {
+		int j0 = 0;
+		p[0] = i;
+		std::fill(minv.begin(), minv.end(), DBL_MAX);
+		std::fill(used.begin(), used.end(), false);
+		do {
+			int i0 = p[j0], j1 = 0;
+			double delta = DBL_MAX;
+			used[j0] = true;
+			for ( int j = 1; j <= cols; j++ ) {
+				if ( used[j] )
+					continue;
+				double cur = cost[(i0 - 1) * cols + (j - 1)] - u[i0] - v[j];
+				if ( cur < minv[j] ) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if ( minv[j] < delta ) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+			for ( int j = 0; j <= cols; j++ ) {
+				if ( used[j] ) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else
+					minv[j] -= delta;
+			}
+			j0 = j1;
+		} while ( p[j0] != 0 );
+		do {
+			int j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while ( j0 != 0 );
+	}
+
+	result.assign(rows, -1);
+	for ( int j = 1; j <= cols; j++ )
+		if ( p[j] != 0 )
+			result[p[j] - 1] = j - 1;
+}
+
 moGreedyBlobTrackerModule::moGreedyBlobTrackerModule() : moModule(MO_MODULE_INPUT | MO_MODULE_OUTPUT, 1, 2){
 
 	MODULE_INIT();
@@ -34,107 +130,413 @@ moGreedyBlobTrackerModule::moGreedyBlobTrackerModule() : moModule(MO_MODULE_INPU
 	this->output_infos[0] = new moDataStreamInfo("data", "moDataGenericList", "Data stream of type 'blob'");
 	this->output_infos[1] = new moDataStreamInfo("image", "IplImage", "Image showing the currently tracked blobs in different colors");
 
-    // How many frames may a blob survive without finding a successor?
+	// How many frames may a blob survive without finding a successor?
 	this->properties["max_age"] = new moProperty(3);
+	this->properties["max_age"]->setMin(0);
 	this->properties["max_dist"] = new moProperty(0.1);
+	this->properties["assignment"] = new moProperty("greedy");
+	this->properties["assignment"]->setChoices("greedy;optimal");
+
+	// alpha-beta filter: alpha = 1 keep measured positions as-is
+	this->properties["filter_alpha"] = new moProperty(1.0);
+	this->properties["filter_beta"] = new moProperty(0.5);
+	this->properties["predict"] = new moProperty(false);
+	this->properties["predict_max"] = new moProperty(0.1);
+
+	this->id_counter = 1;
+	this->frame = 0;
+	this->input_frame.id = 0;
+	this->input_frame.timestamp = 0.;
+	mo_frame_reset_transform(this->input_frame);
+}
 
-    this->id_counter = 1;
-    this->new_blobs = new moDataGenericList();
-    this->old_blobs = new moDataGenericList();
+moGreedyBlobTrackerModule::~moGreedyBlobTrackerModule() {
+	this->clearBlobs();
+	delete this->output;
+}
 
+void moGreedyBlobTrackerModule::stop() {
+	moModule::stop();
+	this->tracks.clear();
+	this->lost.clear();
 }
 
-moGreedyBlobTrackerModule::~moGreedyBlobTrackerModule() {
-    delete this->output;
+void moGreedyBlobTrackerModule::clearBlobs() {
+	moDataGenericList::iterator it;
+	for ( it = this->blobs.begin(); it != this->blobs.end(); it++ )
+		delete (*it);
+	this->blobs.clear();
 }
 
 void moGreedyBlobTrackerModule::pruneBlobs() {
-	// Kill all the blobs that havn't been associated with a successor for too long
+	// Kill all the blobs that havn't been associated with a successor for too long.
+	// Lost blobs are stored in a ring of max_age + 1 slots, by the frame they have
+	// been lost: the slot of the current frame contain the ones that expire now.
+	int max_age = this->property("max_age").asInteger();
+	unsigned int slots = max_age < 0 ? 1 : max_age + 1;
+
+	// max_age changed, redistribute the lost blobs that are still alive
+	if ( this->lost.size() != slots ) {
+		std::vector<std::vector<greedy_track_t> > old;
+		std::vector<std::vector<greedy_track_t> >::iterator it;
+		std::vector<greedy_track_t>::iterator tr;
+
+		old.swap(this->lost);
+		this->lost.resize(slots);
+		for ( it = old.begin(); it != old.end(); it++ ) {
+			for ( tr = it->begin(); tr != it->end(); tr++ ) {
+				if ( this->frame - tr->lost_frame >= slots )
+					continue;
+				this->lost[tr->lost_frame % slots].push_back(*tr);
+			}
+		}
+	}
+
+	this->lost[this->frame % slots].clear();
+}
+
+int moGreedyBlobTrackerModule::findGroup(int n) {
+	while ( this->parent[n] != n ) {
+		this->parent[n] = this->parent[this->parent[n]];
+		n = this->parent[n];
+	}
+	return n;
+}
+
+void moGreedyBlobTrackerModule::findPairs(double max_dist) {
+	double min_x, min_y, max_x, max_y, cell, bx, by, dx, dy, d2;
+	double max_d2 = max_dist * max_dist;
+	unsigned int i, j, cells, limit;
+	int grid_w, grid_h, cx, cy, x, y, k, idx;
+	greedy_pair_t pair;
+
+	this->pairs.clear();
+	if ( max_dist <= 0 || this->candidates.empty() || this->blob_x.empty() )
+		return;
+
+	min_x = max_x = this->candidates[0].x;
+	min_y = max_y = this->candidates[0].y;
+	for ( j = 1; j < this->candidates.size(); j++ ) {
+		min_x = std::min(min_x, this->candidates[j].x);
+		max_x = std::max(max_x, this->candidates[j].x);
+		min_y = std::min(min_y, this->candidates[j].y);
+		max_y = std::max(max_y, this->candidates[j].y);
+	}
+
+	// every candidate within max_dist of a blob is in the blob cell or in one
+	// of its neighbours. Cells are only grown if the grid would be mostly empty.
+	cell = max_dist;
+	limit = 4 * this->candidates.size() + 16;
+	if ( ((max_x - min_x) / cell + 1.) * ((max_y - min_y) / cell + 1.) > limit )
+		cell = std::max(max_x - min_x, max_y - min_y) / (sqrt((double)limit) - 1.);
+
+	grid_w = (int)((max_x - min_x) / cell) + 1;
+	grid_h = (int)((max_y - min_y) / cell) + 1;
+	cells = grid_w * grid_h;
+
+	// counting sort of the candidates into the cells
+	this->grid_start.assign(cells + 1, 0);
+	this->grid_index.resize(this->candidates.size());
+	for ( j = 0; j < this->candidates.size(); j++ ) {
+		cx = (int)((this->candidates[j].x - min_x) / cell);
+		cy = (int)((this->candidates[j].y - min_y) / cell);
+		this->grid_start[cy * grid_w + cx]++;
+	}
+	for ( i = 1; i <= cells; i++ )
+		this->grid_start[i] += this->grid_start[i - 1];
+	for ( j = 0; j < this->candidates.size(); j++ ) {
+		cx = (int)((this->candidates[j].x - min_x) / cell);
+		cy = (int)((this->candidates[j].y - min_y) / cell);
+		this->grid_index[--this->grid_start[cy * grid_w + cx]] = j;
+	}
+
+	for ( i = 0; i < this->blob_x.size(); i++ ) {
+		bx = this->blob_x[i];
+		by = this->blob_y[i];
+
+		// too far from every candidate
+		if ( bx < min_x - cell || bx > max_x + cell ||
+			 by < min_y - cell || by > max_y + cell )
+			continue;
+
+		cx = (int)floor((bx - min_x) / cell);
+		cy = (int)floor((by - min_y) / cell);
+
+		for ( y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid_h - 1); y++ ) {
+			for ( x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid_w - 1); x++ ) {
+				idx = y * grid_w + x;
+				for ( k = this->grid_start[idx]; k < this->grid_start[idx + 1]; k++ ) {
+					j = this->grid_index[k];
+					dx = this->candidates[j].x - bx;
+					dy = this->candidates[j].y - by;
+					d2 = dx * dx + dy * dy;
+					if ( d2 >= max_d2 )
+						continue;
+					pair.blob = i;
+					pair.candidate = j;
+					pair.group = 0;
+					pair.dist = d2;
+					this->pairs.push_back(pair);
+				}
+			}
+		}
+	}
+}
+
+void moGreedyBlobTrackerModule::assignGreedy() {
+	std::vector<greedy_pair_t>::iterator it;
+
+	// closest pairs first
+	std::sort(this->pairs.begin(), this->pairs.end(), _pair_dist_pred);
+
+	for ( it = this->pairs.begin(); it != this->pairs.end(); it++ ) {
+		if ( this->blob_match[it->blob] >= 0 || this->candidates[it->candidate].match >= 0 )
+			continue;
+		this->blob_match[it->blob] = it->candidate;
+		this->candidates[it->candidate].match = it->blob;
+	}
+}
+
+void moGreedyBlobTrackerModule::assignOptimal(double max_dist) {
+	unsigned int n = this->blob_x.size(), first, last, k;
+	int a, b, r, rows, cols;
+	double unmatched = max_dist * max_dist;
+
+	// group blobs and candidates that are connected by a pair:
+	// blobs are nodes [0, n[, candidates [n, n + candidates[
+	this->parent.resize(n + this->candidates.size());
+	for ( k = 0; k < this->parent.size(); k++ )
+		this->parent[k] = k;
+	for ( k = 0; k < this->pairs.size(); k++ ) {
+		a = this->findGroup(this->pairs[k].blob);
+		b = this->findGroup(n + this->pairs[k].candidate);
+		if ( a != b )
+			this->parent[a] = b;
+	}
+	for ( k = 0; k < this->pairs.size(); k++ )
+		this->pairs[k].group = this->findGroup(this->pairs[k].blob);
+
+	std::sort(this->pairs.begin(), this->pairs.end(), _pair_group_pred);
+
+	this->local.assign(n + this->candidates.size(), -1);
+
+	for ( first = 0; first < this->pairs.size(); first = last ) {
+		last = first + 1;
+		while ( last < this->pairs.size() && this->pairs[last].group == this->pairs[first].group )
+			last++;
+
+		// no competition, nothing to solve
+		if ( last - first == 1 ) {
+			this->blob_match[this->pairs[first].blob] = this->pairs[first].candidate;
+			this->candidates[this->pairs[first].candidate].match = this->pairs[first].blob;
+			continue;
+		}
+
+		this->group_rows.clear();
+		this->group_cols.clear();
+		for ( k = first; k < last; k++ ) {
+			a = this->pairs[k].blob;
+			b = n + this->pairs[k].candidate;
+			if ( this->local[a] < 0 ) {
+				this->local[a] = this->group_rows.size();
+				this->group_rows.push_back(a);
+			}
+			if ( this->local[b] < 0 ) {
+				this->local[b] = this->group_cols.size();
+				this->group_cols.push_back(this->pairs[k].candidate);
+			}
+		}
+
+		// each blob have its own "no successor" column, so it is only
+		// matched if that's cheaper than leaving it (and the candidate) alone
+		rows = this->group_rows.size();
+		cols = this->group_cols.size() + rows;
+		this->group_cost.assign(rows * cols, unmatched * 4.);
+		for ( k = first; k < last; k++ ) {
+			a = this->local[this->pairs[k].blob];
+			b = this->local[n + this->pairs[k].candidate];
+			this->group_cost[a * cols + b] = this->pairs[k].dist;
+		}
+		for ( r = 0; r < rows; r++ )
+			this->group_cost[r * cols + this->group_cols.size() + r] = unmatched;
+
+		_solve_assignment(this->group_cost, rows, cols, this->group_result);
+
+		for ( r = 0; r < rows; r++ ) {
+			b = this->group_result[r];
+			if ( b < 0 || b >= (int)this->group_cols.size() )
+				continue;
+			this->blob_match[this->group_rows[r]] = this->group_cols[b];
+			this->candidates[this->group_cols[b]].match = this->group_rows[r];
+		}
+
+		// reset local indexes for the next group
+		for ( r = 0; r < rows; r++ )
+			this->local[this->group_rows[r]] = -1;
+		for ( k = 0; k < this->group_cols.size(); k++ )
+			this->local[n + this->group_cols[k]] = -1;
+	}
 }
 
 void moGreedyBlobTrackerModule::trackBlobs() {
-    
-
-    moDataGenericList::iterator it;
-	for (it = this->new_blobs->begin(); it != this->new_blobs->end(); it++){
-        
-
-
-
-        //for each of blobs in teh new frame, find teh closest matching one from before
-        moDataGenericContainer* closest_blob = NULL;
-        double min_dist = pow(this->properties["max_dist"]->asDouble(), 2);
-        
-        moDataGenericList::iterator it_old;
-	    for (it_old = this->old_blobs->begin(); it_old != this->old_blobs->end(); it_old++){
-            LOG(MO_DEBUG, "old blob:" << (*it_old)->properties["id"]->asString() <<"  x:" << (*it)->properties["x"]->asDouble() );
-            if ((*it_old)->properties["id"]->asInteger() < 0)  //already assigned
-                continue;
-
-            double old_x = (*it_old)->properties["x"]->asDouble();
-			double old_y = (*it_old)->properties["y"]->asDouble();
-			double new_x = (*it)->properties["x"]->asDouble();
-			double new_y = (*it)->properties["y"]->asDouble();
-			double dist = pow(old_x - new_x, 2) + pow(old_y - new_y, 2);
-            
-            
-            //std::cout << "dist: " << dist << " min:" << min_dist << std::endl; 
-            if (dist < min_dist) {
-                closest_blob = (*it_old);
-                min_dist = dist;
-            }
-        }
-        
-        //found the closest one out of teh ones that are left, assign id, and invalidate old blob
-        if (closest_blob){
-            int old_id = closest_blob->properties["id"]->asInteger();
-            (*it)->properties["id"]->set( old_id );
-            closest_blob->properties["id"]->set( -1 * old_id );  //we mark matched blob by negative id's
-        }
-        //this must be a new blob, so assign new ID
-        else{
-            (*it)->properties["id"]->set(++this->id_counter);
-        }
-
-        
-
-    }
+	double max_dist = this->property("max_dist").asDouble();
+	unsigned int slot = this->frame % this->lost.size();
+	unsigned int i, s, c, kept;
+	double latency = 0., dt;
+	greedy_candidate_t candidate;
+	greedy_track_t track;
+	moDataGenericList::iterator it;
+
+	// every track that can still get a successor: the previous frame first,
+	// then the ring of lost tracks
+	this->candidates.clear();
+	candidate.match = -1;
+	for ( i = 0; i < this->tracks.size(); i++ ) {
+		candidate.track = this->tracks[i];
+		this->candidates.push_back(candidate);
+	}
+	for ( s = 0; s < this->lost.size(); s++ ) {
+		for ( i = 0; i < this->lost[s].size(); i++ ) {
+			candidate.track = this->lost[s][i];
+			this->candidates.push_back(candidate);
+		}
+	}
+	for ( i = 0; i < this->candidates.size(); i++ ) {
+		greedy_candidate_t &c = this->candidates[i];
+		dt = this->input_frame.timestamp - c.track.timestamp;
+		c.x = c.track.x + c.track.vx * dt;
+		c.y = c.track.y + c.track.vy * dt;
+	}
+
+	this->blob_match.assign(this->blob_x.size(), -1);
+	this->findPairs(max_dist);
+	if ( this->property("assignment").asString() == "optimal" )
+		this->assignOptimal(max_dist);
+	else
+		this->assignGreedy();
+
+	// revived blobs leave the ring (same order as candidates)
+	c = this->tracks.size();
+	for ( s = 0; s < this->lost.size(); s++ ) {
+		std::vector<greedy_track_t> &list = this->lost[s];
+		for ( i = 0, kept = 0; i < list.size(); i++, c++ ) {
+			if ( this->candidates[c].match >= 0 )
+				continue;
+			list[kept++] = list[i];
+		}
+		list.resize(kept);
+	}
 
+	// blobs of the previous frame without successor enter the ring
+	for ( i = 0; i < this->tracks.size(); i++ ) {
+		if ( this->candidates[i].match >= 0 )
+			continue;
+		this->tracks[i].lost_frame = this->frame;
+		this->lost[slot].push_back(this->tracks[i]);
+	}
+
+	// latency between the frame capture and now
+	if ( this->property("predict").asBool() ) {
+		latency = moUtils::time() - this->input_frame.timestamp;
+		latency = std::max(0., std::min(latency, this->property("predict_max").asDouble()));
+	}
+
+	// assign ids, and remember the blobs for the next frame
+	this->tracks.clear();
+	for ( i = 0, it = this->blobs.begin(); it != this->blobs.end(); it++, i++ ) {
+		track.x = this->blob_x[i];
+		track.y = this->blob_y[i];
+		if ( this->blob_match[i] >= 0 )
+			this->filterBlob(track, &this->candidates[this->blob_match[i]].track);
+		else {
+			track.id = ++this->id_counter;
+			this->filterBlob(track, NULL);
+		}
+		this->tracks.push_back(track);
+
+		(*it)->properties["id"]->set(track.id);
+		(*it)->properties["x"]->set(track.x + track.vx * latency);
+		(*it)->properties["y"]->set(track.y + track.vy * latency);
+		_set_property(*it, "vx", track.vx);
+		_set_property(*it, "vy", track.vy);
+		_set_property(*it, "accel", track.accel);
+	}
+}
+
+void moGreedyBlobTrackerModule::filterBlob(greedy_track_t &track, const greedy_track_t *previous) {
+	double alpha = this->property("filter_alpha").asDouble();
+	double beta = this->property("filter_beta").asDouble();
+	double dt, px, py, rx, ry;
+
+	track.timestamp = this->input_frame.timestamp;
+	track.lost_frame = 0;
+
+	// new track, nothing known about its motion
+	if ( previous == NULL ) {
+		track.vx = track.vy = 0.;
+		track.speed = track.accel = 0.;
+		return;
+	}
+
+	track.id = previous->id;
+	dt = track.timestamp - previous->timestamp;
+	if ( dt <= 0. ) {
+		track.vx = previous->vx;
+		track.vy = previous->vy;
+		track.speed = previous->speed;
+		track.accel = previous->accel;
+		return;
+	}
+
+	// correct the prediction with the measured position (track.x/y)
+	px = previous->x + previous->vx * dt;
+	py = previous->y + previous->vy * dt;
+	rx = track.x - px;
+	ry = track.y - py;
+	track.x = px + alpha * rx;
+	track.y = py + alpha * ry;
+	track.vx = previous->vx + (beta / dt) * rx;
+	track.vy = previous->vy + (beta / dt) * ry;
+	track.speed = sqrt(track.vx * track.vx + track.vy * track.vy);
+	track.accel = (track.speed - previous->speed) / dt;
 }
 
 void moGreedyBlobTrackerModule::update() {
-    LOG(MO_DEBUG, "update called");
-    
-    this->new_blobs->clear();
-   
-    //copy teh new blobs to our new_blobs list, afterwards well assign id's 
-    moDataGenericList::iterator it;
-	moDataGenericList *blobs = (moDataGenericList*) this->input->getData();
-    
-    
-
-    std::cout << blobs->size() << std::endl;
-    this->input->lock();
-	for ( it = blobs->begin(); it != blobs->end(); it++ ){
-        moDataGenericContainer* blob = (*it)->clone();
-        blob->properties["id"] = new moProperty(0);
-        this->new_blobs->push_back(blob);   
-    }
-    this->input->unlock();
-
-   //trck the blobs based on prior frames
-   this->trackBlobs();
-
-   //revive old bobs that just went missing if they are within certain age 
-   //(in case they only dropped out for one or two frames)
-   //this->pruneBlobs();
-
-   this->output->push(this->new_blobs);
-   
-   //make teh new list teh old list
-   moDataGenericList* tmp = this->old_blobs;
-   this->old_blobs = this->new_blobs;
-   this->new_blobs = tmp;
+	moDataGenericList::iterator it;
+	moDataGenericList *list;
+
+	if ( this->input == NULL )
+		return;
+
+	this->clearBlobs();
+	this->blob_x.clear();
+	this->blob_y.clear();
+
+	// copy the new blobs to our list, afterwards we'll assign id's
+	this->input->lock();
+	this->input_frame = this->input->getFrame();
+	list = (moDataGenericList*) this->input->getData();
+	if ( list != NULL ) {
+		for ( it = list->begin(); it != list->end(); it++ ) {
+			moDataGenericContainer *blob = (*it)->clone();
+			if ( blob->exist("id") )
+				delete blob->properties["id"];
+			blob->properties["id"] = new moProperty(0);
+			this->blob_x.push_back(blob->properties["x"]->asDouble());
+			this->blob_y.push_back(blob->properties["y"]->asDouble());
+			this->blobs.push_back(blob);
+		}
+	}
+	this->input->unlock();
+
+	// forget the blobs that have been lost for too long
+	this->pruneBlobs();
+
+	// track the blobs based on prior frames
+	this->trackBlobs();
+
+	this->output->push(&this->blobs, this->input_frame);
+	this->frame++;
 }
 
 void moGreedyBlobTrackerModule::notifyData(moDataStream *input) {
@@ -174,5 +576,3 @@ moDataStream* moGreedyBlobTrackerModule::getInput(int n) {
 moDataStream* moGreedyBlobTrackerModule::getOutput(int n) {
 	return this->output;
 }
-
-
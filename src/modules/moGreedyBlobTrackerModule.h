@@ -19,34 +19,90 @@
 #ifndef MO_GREEDYBLOBTRACKER_MODULE_H
 #define MO_GREEDYBLOBTRACKER_MODULE_H
 
+#include <vector>
 #include "../moModule.h"
 #include "../moDataStream.h"
 #include "../moDataGenericContainer.h"
 #include "cv.h"
 
+typedef struct {
+	int id;
+	double x;
+	double y;
+	double vx;
+	double vy;
+	double speed;
+	double accel;
+	double timestamp;
+	unsigned int lost_frame;
+} greedy_track_t;
+
+typedef struct {
+	greedy_track_t track;
+	double x;		// position predicted for the current frame
+	double y;
+	int match;		// index of the matched new blob, -1 if none
+} greedy_candidate_t;
+
+typedef struct {
+	int blob;
+	int candidate;
+	int group;
+	double dist;
+} greedy_pair_t;
+
 class moGreedyBlobTrackerModule : public moModule {
 public:
 	moGreedyBlobTrackerModule();
 	virtual ~moGreedyBlobTrackerModule();
-	
+
 	virtual void setInput(moDataStream* stream, int n=0);
 	virtual moDataStream *getInput(int n=0);
 	virtual moDataStream *getOutput(int n=0);
-	
+
 	void notifyData(moDataStream *stream);
 	void update();
-	
+	void stop();
+
 private:
 	int id_counter;
-	moDataGenericList* new_blobs;
-	moDataGenericList* old_blobs;
+	unsigned int frame;
+	mo_frame_t input_frame;
+	moDataGenericList blobs;
 
-    moDataStream *input;
+	// tracks matched on the previous frame
+	std::vector<greedy_track_t> tracks;
+
+	// lost tracks, bucketed by (frame lost % (max_age + 1))
+	std::vector<std::vector<greedy_track_t> > lost;
+
+	// per-frame scratch, kept to avoid reallocation
+	std::vector<double> blob_x;
+	std::vector<double> blob_y;
+	std::vector<int> blob_match;
+	std::vector<greedy_candidate_t> candidates;
+	std::vector<int> grid_start;
+	std::vector<int> grid_index;
+	std::vector<greedy_pair_t> pairs;
+	std::vector<int> parent;
+	std::vector<int> local;
+	std::vector<int> group_rows;
+	std::vector<int> group_cols;
+	std::vector<double> group_cost;
+	std::vector<int> group_result;
+
+	moDataStream *input;
 	moDataStream *output;
-	
-    void pruneBlobs();
+
+	void clearBlobs();
+	void pruneBlobs();
 	void trackBlobs();
-	
+	void filterBlob(greedy_track_t &track, const greedy_track_t *previous);
+	void findPairs(double max_dist);
+	void assignGreedy();
+	void assignOptimal(double max_dist);
+	int findGroup(int n);
+
 	MODULE_INTERNALS();
 };
 
@@ -16,6 +16,16 @@
  **********************************************************************/
 
 
+//
+// In gaussian mode, the image minus its gaussian blur is blurred again.
+// Box mode does the same with box blurs (box radius with the same variance
+// than the gaussians): the difference is clipped to 0 as with cvSub, so
+// the thresholds tuned in one mode work in the other. Both boxes are
+// running sums, computed line by line: the cost doesn't depend on the
+// sizes.
+//
+
+#include <math.h>
 #include "moHighpassModule.h"
 #include "../moLog.h"
 #include "cv.h"
@@ -29,13 +39,80 @@ moHighpassModule::moHighpassModule() : moImageFilterModule(){
 	// declare properties
 	this->properties["size"] = new moProperty(2);
 	this->properties["blur"] = new moProperty(2);
+	this->properties["mode"] = new moProperty("gaussian");
+	this->properties["mode"]->setChoices("gaussian;box");
 
+	this->difference = NULL;
 }
 
 moHighpassModule::~moHighpassModule() {
+	if ( this->difference != NULL )
+		cvReleaseImage(&this->difference);
+}
+
+// sigma of cvSmooth for a (size * 2 + 1) gaussian
+static double _sigma(int size) {
+	return size <= 0 ? 0. : 0.3 * (size - 1) + 0.8;
+}
+
+// radius of the box with the given variance: r * (r + 1) / 3
+static int _box_radius(double variance) {
+	return (int)floor((sqrt(1. + 12. * variance) - 1.) * 0.5 + 0.5);
+}
+
+void moHighpassModule::boxHighpass(IplImage *src) {
+	double s1 = _sigma(this->property("size").asInteger());
+	double s2 = _sigma(this->property("blur").asInteger());
+	int count = src->width * src->nChannels;
+	const unsigned int *line;
+	const unsigned char *in;
+	unsigned char *out;
+	float scale, value;
+
+	if ( this->difference != NULL && (this->difference->width != src->width ||
+		 this->difference->height != src->height || this->difference->nChannels != src->nChannels) )
+		cvReleaseImage(&this->difference);
+	if ( this->difference == NULL )
+		this->difference = cvCreateImage(cvGetSize(src), IPL_DEPTH_8U, src->nChannels);
+
+	// image minus its blur, negative values are clipped
+	this->first.start(src, _box_radius(s1 * s1));
+	scale = 1.f / this->first.getArea();
+	for ( int y = 0; y < src->height; y++ ) {
+		if ( y > 0 )
+			this->first.next();
+		line = this->first.getLine();
+		in = (const unsigned char *)src->imageData + y * src->widthStep;
+		out = (unsigned char *)this->difference->imageData + y * this->difference->widthStep;
+		for ( int x = 0; x < count; x++ ) {
+			value = in[x] - line[x] * scale;
+			out[x] = value <= 0.f ? 0 : (unsigned char)(value + 0.5f);
+		}
+	}
+
+	// blur of the difference
+	this->second.start(this->difference, _box_radius(s2 * s2));
+	scale = 1.f / this->second.getArea();
+	for ( int y = 0; y < src->height; y++ ) {
+		if ( y > 0 )
+			this->second.next();
+		line = this->second.getLine();
+		out = (unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep;
+		for ( int x = 0; x < count; x++ )
+			out[x] = (unsigned char)(line[x] * scale + 0.5f);
+	}
 }
 
 void moHighpassModule::applyFilter(IplImage *src) {
+	if ( this->property("mode").asString() == "box" ) {
+		if ( src->depth != IPL_DEPTH_8U ) {
+			this->setError("box mode need a 8 bits image");
+			return;
+		}
+		this->boxHighpass(src);
+		return;
+	}
+
 	int b1 = this->property("size").asInteger()*2+1; //make sure its odd
 	int b2 = this->property("blur").asInteger()*2+1; //make sure its odd
 	cvSmooth(src, this->output_buffer, CV_GAUSSIAN, b1);
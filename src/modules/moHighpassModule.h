@@ -20,6 +20,7 @@
 #define MO_HIGH_PASS_MODULE_H
 
 #include "moImageFilterModule.h"
+#include "../moBoxSums.h"
 
 class moHighpassModule : public moImageFilterModule{
 public:
@@ -28,7 +29,12 @@ public:
 	
 protected:
 	void applyFilter(IplImage *);
+	void boxHighpass(IplImage *src);
 	int size;
+
+	// box of the image (size), and box of the difference (blur)
+	moBoxSums first, second;
+	IplImage *difference;
 	MODULE_INTERNALS();
 };
 
@@ -16,7 +16,14 @@
  **********************************************************************/
 
 
+//
+// The window is refreshed at most max_fps times per second. Receiving a
+// frame only mark it: the image is copied (or reduced by scale) from the
+// input when the window is refreshed, and shown without the input lock.
+//
+
 #include <sstream>
+#include <algorithm>
 #include <assert.h>
 
 #include "cv.h"
@@ -25,6 +32,7 @@
 #include "moImageDisplayModule.h"
 #include "../moDataStream.h"
 #include "../moLog.h"
+#include "../moUtils.h"
 
 MODULE_DECLARE(ImageDisplay, "native", "Display image on a window");
 
@@ -36,6 +44,8 @@ moImageDisplayModule::moImageDisplayModule() : moModule(MO_MODULE_INPUT, 1, 0) {
 
 	this->input = NULL;
 	this->img = NULL;
+	this->pending = false;
+	this->last_refresh = 0.;
 
 	// declare inputs
 	this->input_infos[0] = new moDataStreamInfo(
@@ -45,6 +55,12 @@ moImageDisplayModule::moImageDisplayModule() : moModule(MO_MODULE_INPUT, 1, 0) {
 	std::ostringstream oss;
 	oss << "Movid" << (count++);
 	this->properties["name"] = new moProperty(oss.str());
+	// 0 refresh the window for each frame
+	this->properties["max_fps"] = new moProperty(30.);
+	this->properties["max_fps"]->setMin(0);
+	this->properties["scale"] = new moProperty(1.);
+	this->properties["scale"]->setMin(0.05);
+	this->properties["scale"]->setMax(1);
 }
 
 moImageDisplayModule::~moImageDisplayModule(){
@@ -57,24 +73,30 @@ void moImageDisplayModule::stop() {
 	cvDestroyWindow(this->property("name").asString().c_str());
 }
 
+bool moImageDisplayModule::refreshDue() {
+	double max_fps = this->property("max_fps").asDouble();
+	if ( max_fps <= 0. )
+		return true;
+	return moUtils::time() - this->last_refresh >= 1. / max_fps;
+}
+
 void moImageDisplayModule::notifyData(moDataStream *input) {
 	// ensure that input data is IfiImage
 	assert( input != NULL );
 	assert( input == this->input );
 	assert( input->getFormat() == "IplImage" );
 
+	// out input have been updated ! the image is read on refresh
+	this->pending = true;
+	if ( this->refreshDue() )
+		this->notifyUpdate();
+}
 
-	// out input have been updated !
-	this->input->lock();
-	if ( this->img != NULL ) {
-		cvReleaseImage(&this->img);
-		this->img = NULL;
-	}
-	if ( this->input->getData() != NULL )
-		this->img = cvCloneImage(static_cast<IplImage*>(this->input->getData()));
-	this->input->unlock();
-
-	this->notifyUpdate();
+void moImageDisplayModule::poll() {
+	// the last frame came too early, show it when the time is up
+	if ( this->pending && this->refreshDue() )
+		this->notifyUpdate();
+	moModule::poll();
 }
 
 void moImageDisplayModule::setInput(moDataStream *stream, int n) {
@@ -111,8 +133,40 @@ moDataStream* moImageDisplayModule::getOutput(int n) {
 }
 
 void moImageDisplayModule::update() {
+	IplImage *src;
+	CvSize size;
+	double scale = this->property("scale").asDouble();
+
+	if ( this->input == NULL || !this->pending )
+		return;
+
 	this->input->lock();
-	cvShowImage(this->property("name").asString().c_str(), this->img);
+	src = static_cast<IplImage*>(this->input->getData());
+	if ( src == NULL ) {
+		this->input->unlock();
+		return;
+	}
+
+	size = cvSize(src->width, src->height);
+	if ( scale < 1. ) {
+		size.width = std::max(1, cvRound(src->width * scale));
+		size.height = std::max(1, cvRound(src->height * scale));
+	}
+	if ( this->img == NULL || this->img->width != size.width || this->img->height != size.height
+		 || this->img->depth != src->depth || this->img->nChannels != src->nChannels ) {
+		if ( this->img != NULL )
+			cvReleaseImage(&this->img);
+		this->img = cvCreateImage(size, src->depth, src->nChannels);
+	}
+	if ( size.width == src->width && size.height == src->height )
+		cvCopy(src, this->img);
+	else
+		cvResize(src, this->img, CV_INTER_AREA);
+
+	this->pending = false;
+	this->last_refresh = moUtils::time();
 	this->input->unlock();
+
+	cvShowImage(this->property("name").asString().c_str(), this->img);
 }
 
@@ -37,6 +37,7 @@ public:
 
 	void notifyData(moDataStream *stream);
 	void update();
+	void poll();
 
 	void stop();
 
@@ -44,6 +45,11 @@ private:
 	moDataStream *input;
 	IplImage *img;
 	std::string window_name;
+	// a frame came since the last refresh
+	bool pending;
+	double last_refresh;
+
+	bool refreshDue();
 
 	MODULE_INTERNALS();
 };
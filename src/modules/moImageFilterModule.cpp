@@ -29,6 +29,9 @@ moImageFilterModule::moImageFilterModule() :
 	this->input = NULL;
 	this->output = new moDataStream("IplImage");
 	this->output_buffer = NULL;
+	this->frame.id = 0;
+	this->frame.timestamp = 0.;
+	mo_frame_reset_transform(this->frame);
 
 	// declare input/output
 	this->input_infos[0] = new moDataStreamInfo("image", "IplImage", "Input image stream");
@@ -125,6 +128,7 @@ void moImageFilterModule::update() {
 	if ( this->input->getData() != NULL ) {
 		// duplicate the image, and release as fast as we can the input lock.
 		dup = cvCloneImage(static_cast<IplImage *>(this->input->getData()));
+		this->frame = this->input->getFrame();
 		this->input->unlock();
 
 		// apply the filter
@@ -134,7 +138,7 @@ void moImageFilterModule::update() {
 		cvReleaseImage(&dup);
 
 		// push the new data
-		this->output->push(this->output_buffer);
+		this->output->push(this->output_buffer, this->frame);
 	} else {
 		this->input->unlock();
 	}
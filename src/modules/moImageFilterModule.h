@@ -42,6 +42,9 @@ protected:
 	moDataStream* input;
 	moDataStream* output;
 	IplImage* output_buffer;
+
+	// frame of the image being filtered
+	mo_frame_t frame;
 	
 	virtual void applyFilter(IplImage *)=0;
 	virtual void allocateBuffers();
@@ -21,6 +21,7 @@
 #include "../moLog.h"
 #include "../moModule.h"
 #include "../moDataStream.h"
+#include "../moUtils.h"
 #include "moImageModule.h"
 #include "highgui.h"
 
@@ -36,6 +37,7 @@ moImageModule::moImageModule() : moModule(MO_MODULE_OUTPUT, 0, 1) {
 	MODULE_INIT();
 
 	this->image = NULL;
+	this->last_push = 0.;
 	this->stream = new moDataStream("IplImage");
 
 	// declare outputs
@@ -45,6 +47,10 @@ moImageModule::moImageModule() : moModule(MO_MODULE_OUTPUT, 0, 1) {
 	// declare properties
 	this->properties["filename"] = new moProperty("");
 	this->properties["filename"]->addCallback(fileChangedCallback, this);
+
+	// with fps > 0, push the image again at this rate (as a video)
+	this->properties["fps"] = new moProperty(0.);
+	this->properties["fps"]->setMin(0);
 }
 
 moImageModule::~moImageModule() {
@@ -82,10 +88,18 @@ void moImageModule::stop() {
 	}
 }
 
+void moImageModule::poll() {
+	double fps = this->property("fps").asDouble();
+	if ( fps > 0. && this->image != NULL && moUtils::time() - this->last_push >= 1. / fps )
+		this->notifyUpdate();
+	moModule::poll();
+}
+
 void moImageModule::update() {
 	if ( this->image != NULL ) {
 		// push a new image on the stream
 		LOGM(MO_TRACE, "push a new image on the stream");
+		this->last_push = moUtils::time();
 		this->stream->push(this->image);
 	}
 }
@@ -36,12 +36,14 @@ public:
 	void start();
 	void stop();
 	void update();
+	void poll();
 
 	void reloadImage();
 
 private:
 	IplImage *image;
 	moDataStream *stream;
+	double last_push;
 
 
 	MODULE_INTERNALS();
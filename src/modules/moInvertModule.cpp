@@ -33,4 +33,9 @@ void moInvertModule::applyFilter(IplImage *src) {
 	cvNot(src, this->output_buffer);
 }
 
+void moInvertModule::buildLut(unsigned char *lut) {
+	for ( int i = 0; i < 256; i++ )
+		lut[i] = 255 - i;
+}
+
 
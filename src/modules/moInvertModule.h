@@ -20,15 +20,16 @@
 #define MO_INVERT_MODULE_H
 
 #include <string>
-#include "moImageFilterModule.h"
+#include "moLutModule.h"
 
-class moInvertModule : public moImageFilterModule {
+class moInvertModule : public moLutModule {
 public:
 	moInvertModule();
 	virtual ~moInvertModule();
 
 protected:
 	void applyFilter(IplImage *);
+	void buildLut(unsigned char *lut);
 
 	MODULE_INTERNALS();
 };
@@ -31,7 +31,7 @@ moJustifyModule::moJustifyModule() : moModule(MO_MODULE_INPUT|MO_MODULE_OUTPUT,
 	MODULE_INIT();
 
 	this->properties["dx"] = new moProperty(0.0);
-	this->properties["dx"] = new moProperty(0.0);
+	this->properties["dy"] = new moProperty(0.0);
 	this->properties["ma"] = new moProperty(1.0);
 	this->properties["mb"] = new moProperty(0.0);
 	this->properties["mc"] = new moProperty(0.0);
@@ -62,6 +62,15 @@ void moJustifyModule::notifyData(moDataStream *input) {
 	
 	this->input->lock();
 	moDataGenericList::iterator it;
+
+	// compose the justify with the frame transform, positions are
+	// converted only once
+	mo_frame_t frame = this->input->getFrame();
+	double justify[6] = {
+		this->property("ma").asDouble(), this->property("mb").asDouble(), this->property("dx").asDouble(),
+		this->property("mc").asDouble(), this->property("md").asDouble(), this->property("dy").asDouble()
+	};
+	mo_frame_transform(frame, justify);
 	for (it = this->blobs.begin(); it != this->blobs.end(); it++)
                 delete (*it);
         this->blobs.clear();
@@ -73,25 +82,22 @@ void moJustifyModule::notifyData(moDataStream *input) {
 		} else if (format == "GenericTouch") {
 			assert((*it)->properties["type"]->asString() == "touch");
 		}
-		float x = (float)(*it)->properties["x"]->asDouble();
-		float y = (float)(*it)->properties["y"]->asDouble();
-		float ma = this->property("ma").asDouble();
-		float mb = this->property("mb").asDouble();
-		float mc = this->property("mc").asDouble();
-		float md = this->property("md").asDouble();
-		float dx = this->property("dx").asDouble();
-		float dy = this->property("dy").asDouble();
+		double x = (*it)->properties["x"]->asDouble();
+		double y = (*it)->properties["y"]->asDouble();
 
 		LOGM(MO_INFO, "id=" << (*it)->properties["id"]->asInteger() << " x=" << x << " y=" << y);
 		moDataGenericContainer *touch = new moDataGenericContainer();
 		touch->properties["type"] = new moProperty((*it)->properties["type"]->asString());
 		touch->properties["id"] = new moProperty((*it)->properties["id"]->asInteger());
-		touch->properties["x"] = new moProperty(ma*x + mb*y + dx);
-		touch->properties["y"] = new moProperty(mc*x + md*y + dy);
+		mo_frame_to_source(frame, x, y);
+		touch->properties["x"] = new moProperty(x);
+		touch->properties["y"] = new moProperty(y);
 		if (format == "GenericFiducial") {
 			touch->properties["angle"] = new moProperty((*it)->properties["angle"]->asDouble());
 			touch->properties["leaf_size"] = new moProperty((*it)->properties["leaf_size"]->asDouble());
 			touch->properties["root_size"] = new moProperty((*it)->properties["root_size"]->asDouble());
+			if ( (*it)->exist("session_id") )
+				touch->properties["session_id"] = new moProperty((*it)->properties["session_id"]->asInteger());
 		}
 		if (format == "GenericTouch") {
 			touch->properties["w"] = new moProperty((*it)->properties["w"]->asDouble());
@@ -99,7 +105,8 @@ void moJustifyModule::notifyData(moDataStream *input) {
 		}
 		this->blobs.push_back(touch);
 	}
-	this->output->push(&this->blobs);
+	mo_frame_reset_transform(frame);
+	this->output->push(&this->blobs, frame);
 
 	this->input->unlock();
 }
@@ -0,0 +1,205 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+//
+// Point operations (Invert, Amplify, Threshold...) as 256 values tables.
+// A chain of them cost one pass: each module pass the image and its table
+// to the next one, until the last one which apply the composed table.
+// The composed table is rebuilt only when a property of one of the
+// modules, or the chain, change.
+//
+// The image passed is the buffer of the module before the chain, read
+// later by the next module without its stream lock. This is done only
+// when that module, this one and the next one are run in turn by the
+// pipeline (no use_thread), so the buffer can't be written meanwhile.
+//
+
+#include <assert.h>
+#include <string.h>
+#include "moLutModule.h"
+#include "../moPipeline.h"
+
+// versions of the combined tables, unique across modules
+static int _lut_versions = 0;
+
+static void _lut_changed_cb(moProperty *property, void *userdata) {
+	moLutModule *module = static_cast<moLutModule *>(userdata);
+	module->lut_changed = true;
+}
+
+// apply the table on one line, 4 pixels at a time
+static void _lut_line(unsigned char *dst, const unsigned char *src, const unsigned char *lut, int count) {
+	int x = 0;
+	for ( ; x + 4 <= count; x += 4 ) {
+		dst[x] = lut[src[x]];
+		dst[x + 1] = lut[src[x + 1]];
+		dst[x + 2] = lut[src[x + 2]];
+		dst[x + 3] = lut[src[x + 3]];
+	}
+	for ( ; x < count; x++ )
+		dst[x] = lut[src[x]];
+}
+
+static void _lut_image(IplImage *dst, IplImage *src, const unsigned char *lut) {
+	int line = src->width * src->nChannels;
+	for ( int y = 0; y < src->height; y++ )
+		_lut_line((unsigned char *)dst->imageData + y * dst->widthStep,
+			(const unsigned char *)src->imageData + y * src->widthStep, lut, line);
+}
+
+moLutModule::moLutModule() : moImageFilterModule() {
+	this->lut_changed = true;
+	this->callbacks_added = false;
+	this->combined_version = 0;
+	this->combined_pending = false;
+	this->combined_pending_version = 0;
+	this->pending_version = 0;
+	this->pending_data = NULL;
+}
+
+moLutModule::~moLutModule() {
+}
+
+bool moLutModule::acceptLut(IplImage *src) {
+	return src->depth == IPL_DEPTH_8U;
+}
+
+void moLutModule::setPendingLut(const unsigned char *lut, int version, void *data) {
+	this->pending_mtx.lock();
+	if ( version != this->pending_version )
+		memcpy(this->pending, lut, sizeof(this->pending));
+	this->pending_version = version;
+	this->pending_data = data;
+	this->pending_mtx.unlock();
+}
+
+// the previous modules gave a table for this image, but this filter can't
+// use it: apply it before the filter
+void moLutModule::applyPending(IplImage *src) {
+	this->pending_mtx.lock();
+	if ( this->pending_data != NULL && src->depth == IPL_DEPTH_8U )
+		_lut_image(src, src, this->pending);
+	this->pending_data = NULL;
+	this->pending_mtx.unlock();
+}
+
+bool moLutModule::canPassImage(moLutModule *next) {
+	moPipeline *pipeline = dynamic_cast<moPipeline *>(this->owner);
+	moModule *module;
+	unsigned int i;
+
+	if ( next == NULL || pipeline == NULL
+		 || this->property("use_thread").asBool()
+		 || next->property("use_thread").asBool() )
+		return false;
+
+	// the module that write the image must not have its own thread
+	for ( i = 0; i < pipeline->size(); i++ ) {
+		module = pipeline->getModule(i);
+		if ( module->getOutputIndex(this->input) >= 0 )
+			return !module->property("use_thread").asBool();
+	}
+
+	return false;
+}
+
+void moLutModule::update() {
+	moLutModule *next = NULL;
+	IplImage *src, *dup;
+	bool have_pending, rebuild;
+	int i;
+
+	if ( this->input == NULL )
+		return;
+
+	// any property can change the table
+	if ( !this->callbacks_added ) {
+		std::map<std::string, moProperty*>::iterator it;
+		for ( it = this->properties.begin(); it != this->properties.end(); it++ )
+			it->second->addCallback(_lut_changed_cb, this);
+		this->callbacks_added = true;
+	}
+
+	this->input->lock();
+
+	src = static_cast<IplImage *>(this->input->getData());
+	if ( src == NULL ) {
+		this->input->unlock();
+		return;
+	}
+
+	if ( !this->acceptLut(src) ) {
+		dup = cvCloneImage(src);
+		this->frame = this->input->getFrame();
+		this->input->unlock();
+
+		this->applyPending(dup);
+		this->applyFilter(dup);
+		cvReleaseImage(&dup);
+
+		this->output->push(this->output_buffer, this->frame);
+		return;
+	}
+
+	this->frame = this->input->getFrame();
+
+	// previous modules tables, if they are for this image
+	this->pending_mtx.lock();
+	have_pending = this->pending_data == src;
+	this->pending_data = NULL;
+
+	rebuild = false;
+	if ( this->lut_changed ) {
+		this->lut_changed = false;
+		this->buildLut(this->lut);
+		rebuild = true;
+	}
+	if ( have_pending != this->combined_pending ||
+		 ( have_pending && this->pending_version != this->combined_pending_version ) )
+		rebuild = true;
+
+	if ( rebuild ) {
+		if ( have_pending ) {
+			for ( i = 0; i < 256; i++ )
+				this->combined[i] = this->lut[this->pending[i]];
+		} else
+			memcpy(this->combined, this->lut, sizeof(this->combined));
+		this->combined_pending = have_pending;
+		this->combined_pending_version = this->pending_version;
+		this->combined_version = pt::pincrement(&_lut_versions);
+	}
+	this->pending_mtx.unlock();
+
+	// only a table module after this one: let it do the pass
+	if ( this->output->getObserverCount() == 1 )
+		next = dynamic_cast<moLutModule *>(this->output->getObserver(0));
+
+	if ( this->canPassImage(next) ) {
+		next->setPendingLut(this->combined, this->combined_version, src);
+		this->input->unlock();
+		this->output->push(src, this->frame);
+		return;
+	}
+
+	_lut_image(this->output_buffer, src, this->combined);
+	this->input->unlock();
+
+	this->output->push(this->output_buffer, this->frame);
+}
+
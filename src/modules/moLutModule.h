@@ -0,0 +1,85 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#ifndef MO_LUT_MODULE_H
+#define MO_LUT_MODULE_H
+
+#include "pasync.h"
+#include "moImageFilterModule.h"
+
+/*! \brief Image filter that is a function of each 8 bits value
+ *
+ * The filter is a table of 256 values, built only when a property change.
+ * When the only module after it is also a moLutModule, the image is not
+ * touched: it is passed as is with the table, and the next module apply
+ * both tables in one pass. Only done when no module of the chain, nor the
+ * one writing the image, use a thread.
+ */
+class moLutModule : public moImageFilterModule {
+public:
+	moLutModule();
+	virtual ~moLutModule();
+
+	virtual void update();
+
+	/*! \brief Give the table to apply on the next image before this filter
+	 *
+	 * Called by the previous module, just before it push the image.
+	 */
+	void setPendingLut(const unsigned char *lut, int version, void *data);
+
+	bool lut_changed;
+
+protected:
+	/*! \brief Tell if the filter can be done with the table for this image
+	 *
+	 * By default, every 8 bits image.
+	 */
+	virtual bool acceptLut(IplImage *src);
+
+	/*! \brief Fill the 256 values table of the filter
+	 */
+	virtual void buildLut(unsigned char *lut) = 0;
+
+	// table of this filter
+	unsigned char lut[256];
+	// table of the previous modules, then this filter
+	unsigned char combined[256];
+	int combined_version;
+	// version of the previous modules table in combined, if any
+	bool combined_pending;
+	int combined_pending_version;
+
+	// table of the previous modules, for the image pending_data
+	pt::mutex pending_mtx;
+	unsigned char pending[256];
+	int pending_version;
+	void *pending_data;
+
+	bool callbacks_added;
+
+	void applyPending(IplImage *src);
+
+	/*! \brief Tell if the input image can be passed to the next module
+	 */
+	bool canPassImage(moLutModule *next);
+};
+
+#endif
+
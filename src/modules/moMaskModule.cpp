@@ -16,12 +16,33 @@
  **********************************************************************/
 
 
+
+//
+// The mask is converted once to the input format, and cut in tiles that
+// are fully masked, fully open, or mixed. The output pixels of masked
+// tiles are cleared once, open tiles are copied, and only the mixed ones
+// are and'ed with the mask. Images asked with saveas are written by a
+// separate thread.
+//
+
 #include <assert.h>
+#include <string.h>
 #include "moMaskModule.h"
 #include "../moLog.h"
+#include "../moThread.h"
 #include "cv.h"
 #include "highgui.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MASK_TILE_SIZE	16
+
+#define MASK_TILE_MASKED	0
+#define MASK_TILE_OPEN		1
+#define MASK_TILE_MIXED		2
+
 MODULE_DECLARE(Mask, "native", "Mask Description");
 
 void internal_saveas_cb(moProperty *prop, void *_inst) {
@@ -34,6 +55,29 @@ void maskfileChangedCallback(moProperty *prop, void *_inst) {
 	inst->reloadMask();
 }
 
+static void _save_thread(moThread *thread) {
+	moMaskModule *module = static_cast<moMaskModule *>(thread->getUserData());
+
+	while ( true ) {
+		module->save_trigger->wait();
+		if ( thread->wantQuit() )
+			break;
+		module->saveImage();
+	}
+}
+
+static void _and_line(unsigned char *dst, const unsigned char *src, const unsigned char *mask, int count) {
+	int x = 0;
+#ifdef __SSE2__
+	for ( ; x + 16 <= count; x += 16 ) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i m = _mm_loadu_si128((const __m128i *)(mask + x));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_and_si128(v, m));
+	}
+#endif
+	for ( ; x < count; x++ )
+		dst[x] = src[x] & mask[x];
+}
 
 moMaskModule::moMaskModule() : moImageFilterModule(){
 
@@ -46,31 +90,196 @@ moMaskModule::moMaskModule() : moImageFilterModule(){
 	this->properties["filename"]->addCallback(maskfileChangedCallback, this);
 
 	this->mask_buffer = NULL;
+	this->mask = NULL;
+	this->mask_changed = true;
 	this->save_data = false;
+	this->save_thread = NULL;
+	this->save_trigger = NULL;
+	this->save_buffer = NULL;
+	this->saving = 0;
 }
 
 moMaskModule::~moMaskModule() {
+	if ( this->save_thread != NULL ) {
+		this->save_thread->stop();
+		this->save_trigger->post();
+		this->save_thread->waitfor();
+		delete this->save_thread;
+		delete this->save_trigger;
+	}
+	if ( this->save_buffer != NULL )
+		cvReleaseImage(&this->save_buffer);
+	if ( this->mask != NULL )
+		cvReleaseImage(&this->mask);
 	if (this->mask_buffer != NULL)
 		cvReleaseImage(&(this->mask_buffer));
 }
 
+void moMaskModule::allocateBuffers() {
+	moImageFilterModule::allocateBuffers();
+	// the masked pixels of the new buffer must be cleared
+	this->mask_changed = true;
+}
+
+void moMaskModule::prepareMask(IplImage *src) {
+	int x, y, tx, ty, tile_width, tile_height, line, type, count[3] = {0, 0, 0};
+	int pixel = src->nChannels;
+	bool zero, full;
+	mask_span_t span;
+	const unsigned char *p;
+
+	this->mask_changed = false;
+	this->spans.clear();
+	this->row_spans.clear();
+	if ( this->mask != NULL )
+		cvReleaseImage(&this->mask);
+
+	if ( this->mask_buffer == NULL )
+		return;
+
+	if ( this->mask_buffer->width != src->width || this->mask_buffer->height != src->height ) {
+		LOGM(MO_ERROR, "mask is " << this->mask_buffer->width << "x" << this->mask_buffer->height
+			<< ", image is " << src->width << "x" << src->height);
+		this->setError("Mask size doesn't match the image");
+		return;
+	}
+
+	if ( src->depth != IPL_DEPTH_8U || this->mask_buffer->depth != IPL_DEPTH_8U ) {
+		this->setError("Mask and image must be 8 bits images");
+		return;
+	}
+
+	// convert the mask to the input format
+	this->mask = cvCreateImage(cvGetSize(src), IPL_DEPTH_8U, src->nChannels);
+	if ( this->mask_buffer->nChannels == src->nChannels )
+		cvCopy(this->mask_buffer, this->mask);
+	else if ( this->mask_buffer->nChannels == 3 && src->nChannels == 1 )
+		cvCvtColor(this->mask_buffer, this->mask, CV_BGR2GRAY);
+	else if ( this->mask_buffer->nChannels == 1 && src->nChannels == 3 )
+		cvCvtColor(this->mask_buffer, this->mask, CV_GRAY2BGR);
+	else {
+		cvReleaseImage(&this->mask);
+		this->setError("Unsupported mask format");
+		return;
+	}
+
+	// classify the tiles, and merge the following tiles of the same type
+	for ( ty = 0; ty * MASK_TILE_SIZE < src->height; ty++ ) {
+		this->row_spans.push_back(this->spans.size());
+		tile_height = src->height - ty * MASK_TILE_SIZE;
+		if ( tile_height > MASK_TILE_SIZE )
+			tile_height = MASK_TILE_SIZE;
+
+		for ( tx = 0; tx * MASK_TILE_SIZE < src->width; tx++ ) {
+			tile_width = src->width - tx * MASK_TILE_SIZE;
+			if ( tile_width > MASK_TILE_SIZE )
+				tile_width = MASK_TILE_SIZE;
+			line = tile_width * pixel;
+
+			zero = full = true;
+			for ( y = 0; y < tile_height; y++ ) {
+				p = (const unsigned char *)this->mask->imageData
+					+ (ty * MASK_TILE_SIZE + y) * this->mask->widthStep
+					+ tx * MASK_TILE_SIZE * pixel;
+				for ( x = 0; x < line; x++ ) {
+					zero = zero && p[x] == 0;
+					full = full && p[x] == 255;
+				}
+			}
+			type = zero ? MASK_TILE_MASKED : (full ? MASK_TILE_OPEN : MASK_TILE_MIXED);
+			count[type]++;
+
+			span.start = tx * MASK_TILE_SIZE * pixel;
+			span.end = span.start + line;
+			span.type = type;
+			if ( (int)this->spans.size() > this->row_spans.back()
+				&& this->spans.back().type == type )
+				this->spans.back().end = span.end;
+			else
+				this->spans.push_back(span);
+		}
+	}
+	this->row_spans.push_back(this->spans.size());
+
+	// masked pixels are never written again
+	cvSetZero(this->output_buffer);
+
+	LOGM(MO_INFO, "mask tiles: " << count[MASK_TILE_MASKED] << " masked, "
+		<< count[MASK_TILE_OPEN] << " open, " << count[MASK_TILE_MIXED] << " mixed");
+}
+
+void moMaskModule::startSave(IplImage *src) {
+	if ( this->save_thread == NULL ) {
+		this->save_trigger = new pt::trigger(true, false);
+		this->save_thread = new moThread(_save_thread, this);
+		this->save_thread->start();
+	}
+
+	// the previous image is still being written (the flag is cleared
+	// by the save thread)
+	if ( pt::pexchange(&this->saving, 1) != 0 ) {
+		LOGM(MO_WARNING, "already saving an image, ignore saveas");
+		return;
+	}
+
+	if ( this->save_buffer != NULL &&
+		( this->save_buffer->width != src->width || this->save_buffer->height != src->height
+		  || this->save_buffer->nChannels != src->nChannels || this->save_buffer->depth != src->depth ) )
+		cvReleaseImage(&this->save_buffer);
+	if ( this->save_buffer == NULL )
+		this->save_buffer = cvCreateImage(cvGetSize(src), src->depth, src->nChannels);
+
+	cvCopy(src, this->save_buffer);
+	this->save_filename = this->property("saveas").asString();
+	this->save_trigger->post();
+}
+
+void moMaskModule::saveImage() {
+	LOGM(MO_INFO, "saving current image as " << this->save_filename);
+	if ( !cvSaveImage(this->save_filename.c_str(), this->save_buffer) )
+		LOGM(MO_ERROR, "unable to save image as " << this->save_filename);
+	pt::pexchange(&this->saving, 0);
+}
+
 void moMaskModule::applyFilter(IplImage *src) {
+	const unsigned char *in, *mask;
+	unsigned char *out;
+	int y, i, end;
+
 	assert( this->output_buffer != NULL );
 
 	if ( src == NULL )
 		return;
 
 	if (this->save_data) {
-		LOGM(MO_INFO, "saving current image as " << this->property("saveas").asString());
-		cvSaveImage(this->property("saveas").asString().c_str(), src);
+		this->startSave(src);
 		this->save_data = false;
 	}
 
-	// do masking
-	if (this->mask_buffer != NULL) {
-		cvAnd(src, this->mask_buffer, this->output_buffer);
-	} else {
+	if ( this->mask_changed || ( this->mask != NULL &&
+		 ( this->mask->width != src->width || this->mask->height != src->height
+		   || this->mask->nChannels != src->nChannels ) ) )
+		this->prepareMask(src);
+
+	// no mask, just copy
+	if ( this->mask == NULL ) {
 		cvCopy(src, this->output_buffer);
+		return;
+	}
+
+	// do masking
+	for ( y = 0; y < src->height; y++ ) {
+		in = (const unsigned char *)src->imageData + y * src->widthStep;
+		out = (unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep;
+		mask = (const unsigned char *)this->mask->imageData + y * this->mask->widthStep;
+		end = this->row_spans[y / MASK_TILE_SIZE + 1];
+		for ( i = this->row_spans[y / MASK_TILE_SIZE]; i < end; i++ ) {
+			const mask_span_t &span = this->spans[i];
+			if ( span.type == MASK_TILE_OPEN )
+				memcpy(out + span.start, in + span.start, span.end - span.start);
+			else if ( span.type == MASK_TILE_MIXED )
+				_and_line(out + span.start, in + span.start, mask + span.start, span.end - span.start);
+		}
 	}
 }
 
@@ -81,6 +290,7 @@ void moMaskModule::reloadMask() {
 	}
 
 	this->mask_buffer = cvLoadImage(this->property("filename").asString().c_str());
+	this->mask_changed = true;
 	if ( this->mask_buffer == NULL ) {
 		LOGM(MO_ERROR, "could not load mask file: " << this->property("filename").asString());
 		this->setError("unable to load mask file");
@@ -90,4 +300,3 @@ void moMaskModule::reloadMask() {
 	}
 
 }
-
@@ -16,24 +16,58 @@
  **********************************************************************/
 
 
+
 #ifndef MO_MASK_MODULE_H
 #define MO_MASK_MODULE_H
 
+#include <string>
+#include <vector>
+#include "pasync.h"
 #include "moImageFilterModule.h"
 
+class moThread;
+
+// part of a line of tiles that is masked, open, or need the and
+typedef struct {
+	int start;		/*< first byte in the line */
+	int end;		/*< after the last byte */
+	int type;		/*< MASK_TILE_* */
+} mask_span_t;
+
 class moMaskModule : public moImageFilterModule{
 public:
 	moMaskModule();
 	virtual ~moMaskModule();
 
 	void reloadMask();
+	void saveImage();
 
 	bool save_data;
+	bool mask_changed;
+
+	// used by the save thread
+	pt::trigger *save_trigger;
 	
 protected:
+	// mask as loaded from the file
 	IplImage* mask_buffer;
+	// mask converted to the input format
+	IplImage* mask;
+
+	// spans of each line of tiles, row_spans[i] is the first span of line i
+	std::vector<mask_span_t> spans;
+	std::vector<int> row_spans;
+
+	moThread *save_thread;
+	IplImage *save_buffer;
+	std::string save_filename;
+	// 1 while the save thread use save_buffer, swapped with pt::pexchange
+	int saving;
 
+	void prepareMask(IplImage *src);
+	void startSave(IplImage *src);
 	void applyFilter(IplImage *);
+	void allocateBuffers();
 
 	MODULE_INTERNALS();
 };
@@ -16,6 +16,13 @@
  **********************************************************************/
 
 
+//
+// In image mode, the image is flipped. In coordinates mode, the image is
+// passed untouched and the flip is added to the frame transform: the
+// positions found after it are mirrored without any pixel copy, but the
+// modules working on pixels (Roi...) see the image as it was.
+//
+
 #include "moMirrorImageModule.h"
 #include "../moLog.h"
 #include "cv.h"
@@ -27,6 +34,9 @@ moMirrorImageModule::moMirrorImageModule() : moImageFilterModule(){
 	MODULE_INIT();
 
 	this->properties["mirrorAxis"] = new moProperty("x");
+	this->properties["mirrorAxis"]->setChoices("x;y;both");
+	this->properties["mode"] = new moProperty("image");
+	this->properties["mode"]->setChoices("image;coordinates");
 }
 
 moMirrorImageModule::~moMirrorImageModule() {
@@ -53,4 +63,33 @@ void moMirrorImageModule::applyFilter(IplImage *src) {
 	);
 }
 
+void moMirrorImageModule::update() {
+	// cvFlip codes: 0 flip y, 1 flip x, -1 both
+	static const double flips[3][6] = {
+		{ -1., 0., 1., 0., -1., 1. },
+		{ 1., 0., 0., 0., -1., 1. },
+		{ -1., 0., 1., 0., 1., 0. },
+	};
+	mo_frame_t frame;
+	void *data;
+
+	if ( this->property("mode").asString() != "coordinates" ) {
+		moImageFilterModule::update();
+		return;
+	}
+
+	if ( this->input == NULL )
+		return;
+
+	this->input->lock();
+	data = this->input->getData();
+	frame = this->input->getFrame();
+	this->input->unlock();
+
+	if ( data == NULL )
+		return;
+
+	mo_frame_transform(frame, flips[this->toCvType(this->property("mirrorAxis").asString()) + 1]);
+	this->output->push(data, frame);
+}
 
@@ -25,7 +25,9 @@ class moMirrorImageModule : public moImageFilterModule{
 public:
 	moMirrorImageModule();
 	virtual ~moMirrorImageModule();
-	
+
+	virtual void update();
+
 protected:
 	int toCvType(const std::string &axis);
 	void applyFilter(IplImage *);
@@ -0,0 +1,286 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+
+//
+// Erode, dilate, open, close and gradient with a rectangular kernel, using
+// the van Herk / Gil-Werman algorithm: the cost per pixel doesn't depend on
+// the kernel size. The kernel is separated into a horizontal and a vertical
+// pass. For open and close, the horizontal pass of the second operation is
+// done on each line as the first one output it. As cvErode / cvDilate, the
+// pixels outside the image are ignored.
+//
+
+#include <assert.h>
+#include <string.h>
+#include "moMorphologyModule.h"
+#include "../moLog.h"
+#include "cv.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+MODULE_DECLARE(Morphology, "native", "Erode, dilate, open, close or gradient with a rectangular kernel");
+
+enum {
+	MORPH_NONE = -1,
+	MORPH_ERODE = 0,
+	MORPH_DILATE = 1
+};
+
+// dst = min(a, b), or max(a, b) when dilating
+static void _extremum_line(unsigned char *dst, const unsigned char *a,
+						   const unsigned char *b, int count, bool dilate) {
+	int x = 0;
+#ifdef __SSE2__
+	if ( dilate ) {
+		for ( ; x + 16 <= count; x += 16 )
+			_mm_storeu_si128((__m128i *)(dst + x), _mm_max_epu8(
+				_mm_loadu_si128((const __m128i *)(a + x)),
+				_mm_loadu_si128((const __m128i *)(b + x))));
+	} else {
+		for ( ; x + 16 <= count; x += 16 )
+			_mm_storeu_si128((__m128i *)(dst + x), _mm_min_epu8(
+				_mm_loadu_si128((const __m128i *)(a + x)),
+				_mm_loadu_si128((const __m128i *)(b + x))));
+	}
+#endif
+	if ( dilate ) {
+		for ( ; x < count; x++ )
+			dst[x] = a[x] > b[x] ? a[x] : b[x];
+	} else {
+		for ( ; x < count; x++ )
+			dst[x] = a[x] < b[x] ? a[x] : b[x];
+	}
+}
+
+// dst = a - b, saturated to 0
+static void _difference_line(unsigned char *dst, const unsigned char *a,
+							 const unsigned char *b, int count) {
+	int x = 0;
+#ifdef __SSE2__
+	for ( ; x + 16 <= count; x += 16 )
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_subs_epu8(
+			_mm_loadu_si128((const __m128i *)(a + x)),
+			_mm_loadu_si128((const __m128i *)(b + x))));
+#endif
+	for ( ; x < count; x++ )
+		dst[x] = a[x] > b[x] ? a[x] - b[x] : 0;
+}
+
+moMorphologyModule::moMorphologyModule() : moImageFilterModule(){
+
+	MODULE_INIT();
+
+	this->properties["operation"] = new moProperty("open");
+	this->properties["operation"]->setChoices("erode;dilate;open;close;gradient");
+	this->properties["width"] = new moProperty(3);
+	this->properties["width"]->setMin(1);
+	this->properties["width"]->setMax(101);
+	this->properties["height"] = new moProperty(3);
+	this->properties["height"]->setMin(1);
+	this->properties["height"]->setMax(101);
+}
+
+moMorphologyModule::~moMorphologyModule() {
+}
+
+// prefix and suffix extremums of each block of size values in v, where
+// the values of one channel are step bytes apart. count is a multiple of
+// size * step, the first value of a block is its prefix, the last its
+// suffix.
+static void _block_extremums(unsigned char *prefix, unsigned char *suffix,
+							 const unsigned char *v, int count, int size, int step, bool dilate) {
+	int block = size * step;
+	int b, i, end;
+
+	for ( b = 0; b < count; b += block ) {
+		end = b + block;
+		memcpy(prefix + b, v + b, step);
+		memcpy(suffix + end - step, v + end - step, step);
+		if ( dilate ) {
+			for ( i = b + step; i < end; i++ )
+				prefix[i] = prefix[i - step] > v[i] ? prefix[i - step] : v[i];
+			for ( i = end - step - 1; i >= b; i-- )
+				suffix[i] = suffix[i + step] > v[i] ? suffix[i + step] : v[i];
+		} else {
+			for ( i = b + step; i < end; i++ )
+				prefix[i] = prefix[i - step] < v[i] ? prefix[i - step] : v[i];
+			for ( i = end - step - 1; i >= b; i-- )
+				suffix[i] = suffix[i + step] < v[i] ? suffix[i + step] : v[i];
+		}
+	}
+}
+
+// horizontal pass on one line. The line is copied with its border padding,
+// to a multiple of the kernel width, the prefix and suffix extremums are
+// taken in each block, then each output is the extremum of a suffix and a
+// prefix.
+void moMorphologyModule::row(const unsigned char *in, unsigned char *out, bool dilate) {
+	int size = this->kernel_width;
+	int channels = this->channels;
+	int anchor = (size / 2) * channels;
+	int padded = (int)this->row_padded.size();
+	unsigned char *v = &this->row_padded[0];
+
+	if ( size == 1 ) {
+		if ( out != in )
+			memcpy(out, in, this->count);
+		return;
+	}
+
+	memset(v, dilate ? 0 : 255, anchor);
+	memcpy(v + anchor, in, this->count);
+	memset(v + anchor + this->count, dilate ? 0 : 255, padded - anchor - this->count);
+
+	_block_extremums(&this->row_prefix[0], &this->row_suffix[0], v, padded, size, channels, dilate);
+	_extremum_line(out, &this->row_suffix[0], &this->row_prefix[(size - 1) * channels], this->count, dilate);
+}
+
+// vertical pass, the same on whole lines. If next is not MORPH_NONE, the
+// horizontal pass of the next operation is done on each line before it's
+// written: out receives both passes, the output of this one alone is
+// never stored.
+void moMorphologyModule::columns(const unsigned char *in, int in_step,
+								 unsigned char *out, int out_step, bool dilate, int next) {
+	int size = this->kernel_height;
+	int anchor = size / 2;
+	int padded = this->height + size - 1;
+	int count = this->count;
+	unsigned char *prefix = &this->prefix[0];
+	unsigned char *suffix = &this->suffix[0];
+	unsigned char *padding = &this->padding[0];
+	const unsigned char *v;
+	int i, y, py;
+
+	memset(padding, dilate ? 0 : 255, count);
+
+	for ( i = 0; i < padded; i++ ) {
+		py = i - anchor;
+		v = py >= 0 && py < this->height ? in + py * in_step : padding;
+		if ( i % size == 0 )
+			memcpy(prefix + i * count, v, count);
+		else
+			_extremum_line(prefix + i * count, prefix + (i - 1) * count, v, count, dilate);
+	}
+	for ( i = padded - 1; i >= 0; i-- ) {
+		py = i - anchor;
+		v = py >= 0 && py < this->height ? in + py * in_step : padding;
+		if ( i % size == size - 1 || i == padded - 1 )
+			memcpy(suffix + i * count, v, count);
+		else
+			_extremum_line(suffix + i * count, suffix + (i + 1) * count, v, count, dilate);
+	}
+
+	for ( y = 0; y < this->height; y++ ) {
+		if ( next == MORPH_NONE ) {
+			_extremum_line(out + y * out_step, suffix + y * count,
+				prefix + (y + size - 1) * count, count, dilate);
+			continue;
+		}
+		_extremum_line(&this->line[0], suffix + y * count,
+			prefix + (y + size - 1) * count, count, dilate);
+		this->row(&this->line[0], out + y * out_step, next == MORPH_DILATE);
+	}
+}
+
+// erode or dilate, through the first intermediate image
+void moMorphologyModule::single(IplImage *src, unsigned char *out, int out_step, bool dilate) {
+	const unsigned char *in = (const unsigned char *)src->imageData;
+	unsigned char *first = &this->first[0];
+	int y;
+
+	for ( y = 0; y < this->height; y++ )
+		this->row(in + y * src->widthStep, first + y * this->count, dilate);
+	this->columns(first, this->count, out, out_step, dilate, MORPH_NONE);
+}
+
+void moMorphologyModule::applyFilter(IplImage *src) {
+	std::string operation = this->property("operation").asString();
+	const unsigned char *in = (const unsigned char *)src->imageData;
+	unsigned char *out = (unsigned char *)this->output_buffer->imageData;
+	int out_step = this->output_buffer->widthStep;
+	unsigned char *first, *second;
+	bool dilate;
+	int y;
+
+	if ( src->depth != IPL_DEPTH_8U ) {
+		this->setError("Morphology input image must be a 8 bits image.");
+		this->stop();
+		return;
+	}
+
+	this->width = src->width;
+	this->height = src->height;
+	this->channels = src->nChannels;
+	this->count = src->width * src->nChannels;
+	this->kernel_width = this->property("width").asInteger();
+	this->kernel_height = this->property("height").asInteger();
+	if ( this->kernel_width < 1 )
+		this->kernel_width = 1;
+	if ( this->kernel_height < 1 )
+		this->kernel_height = 1;
+
+	// whole blocks of kernel_width pixels, at least width + kernel_width - 1
+	this->row_padded.resize((this->width + this->kernel_width * 2 - 2)
+		/ this->kernel_width * this->kernel_width * this->channels);
+	this->row_prefix.resize(this->row_padded.size());
+	this->row_suffix.resize(this->row_padded.size());
+	this->prefix.resize((this->height + this->kernel_height - 1) * this->count);
+	this->suffix.resize(this->prefix.size());
+	this->padding.resize(this->count);
+	this->line.resize(this->count);
+	this->first.resize(this->height * this->count);
+	first = &this->first[0];
+
+	if ( operation == "erode" || operation == "dilate" ) {
+		this->single(src, out, out_step, operation == "dilate");
+		return;
+	}
+
+	if ( operation == "gradient" ) {
+		this->second.resize(this->height * this->count);
+		second = &this->second[0];
+		this->single(src, out, out_step, true);
+		this->single(src, second, this->count, false);
+		for ( y = 0; y < this->height; y++ )
+			_difference_line(out + y * out_step, out + y * out_step,
+				second + y * this->count, this->count);
+		return;
+	}
+
+	if ( operation != "open" && operation != "close" ) {
+		this->setError("Unsupported morphology operation");
+		return;
+	}
+
+	// open is erode then dilate, close is dilate then erode. The second
+	// horizontal pass is done by the first vertical one, so second holds
+	// the image after three of the four passes.
+	this->second.resize(this->height * this->count);
+	second = &this->second[0];
+	dilate = operation == "close";
+	for ( y = 0; y < this->height; y++ )
+		this->row(in + y * src->widthStep, first + y * this->count, dilate);
+	this->columns(first, this->count, second, this->count, dilate,
+		dilate ? MORPH_ERODE : MORPH_DILATE);
+	this->columns(second, this->count, out, out_step, !dilate, MORPH_NONE);
+}
+
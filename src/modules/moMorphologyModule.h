@@ -0,0 +1,58 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#ifndef MO_MORPHOLOGY_MODULE_H
+#define MO_MORPHOLOGY_MODULE_H
+
+#include <vector>
+#include "moImageFilterModule.h"
+
+class moMorphologyModule : public moImageFilterModule{
+public:
+	moMorphologyModule();
+	virtual ~moMorphologyModule();
+
+protected:
+	void applyFilter(IplImage *);
+	void row(const unsigned char *in, unsigned char *out, bool dilate);
+	void columns(const unsigned char *in, int in_step, unsigned char *out, int out_step, bool dilate, int next);
+	void single(IplImage *src, unsigned char *out, int out_step, bool dilate);
+
+	int width, height, channels, count;
+	int kernel_width, kernel_height;
+
+	// van Herk / Gil-Werman prefix and suffix extremums, of a line for the
+	// horizontal pass and of whole lines for the vertical one
+	std::vector<unsigned char> row_padded;
+	std::vector<unsigned char> row_prefix;
+	std::vector<unsigned char> row_suffix;
+	std::vector<unsigned char> prefix;
+	std::vector<unsigned char> suffix;
+	// border padding and one line of the intermediate passes
+	std::vector<unsigned char> padding;
+	std::vector<unsigned char> line;
+	// intermediate images, count bytes per line
+	std::vector<unsigned char> first;
+	std::vector<unsigned char> second;
+
+	MODULE_INTERNALS();
+};
+
+#endif
+
@@ -16,12 +16,31 @@
  **********************************************************************/
 
 
+//
+// A peak is a pixel with a value in ]min_value, max_value[ that is a local
+// maximum of its 3x3 neighborhood: greater than the neighbors before it
+// (in reading order), greater or equal to the ones after it. A plateau
+// gives one candidate for each of its pixels with no equal neighbor before
+// it, so one for a rectangle but several for other shapes (an L gives
+// two); merge_distance drops them when the plateau is smaller than it.
+// The image is scanned line by line, 16 pixels at a time with SSE2. The
+// strongest candidates are then taken first, and a candidate closer than
+// merge_distance to an accepted peak is dropped, until max_peaks peaks are
+// accepted. The peaks are published as blobs on output 1.
+//
+
 #include <math.h>
+#include <string.h>
 #include <assert.h>
+#include <algorithm>
 #include "moPeakFinderModule.h"
 #include "../moLog.h"
 #include "cv.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 MODULE_DECLARE(PeakFinder, "native", "PeakFinder Description");
 
 moPeakFinderModule::moPeakFinderModule() : moImageFilterModule(){
@@ -38,57 +57,190 @@ moPeakFinderModule::moPeakFinderModule() : moImageFilterModule(){
 	// Avoid duplicate peaks that are close to each other.
 	this->properties["merge_distance"] = new moProperty(4.);
 
-//	this->output_data = new moDataStream("GenericBlob");
-//	this->output_count = 2;
-//	this->output_infos[1] = new moDataStreamInfo("data", "GenericBlob", "Data stream with Blob info");
+	this->output_data = new moDataStream("GenericBlob");
+	this->output_count = 2;
+	this->output_infos[1] = new moDataStreamInfo("data", "GenericBlob", "Data stream with Blob info");
+	this->blobs = new moDataGenericList();
 }
 
 moPeakFinderModule::~moPeakFinderModule() {
+	this->clearBlobs();
+	delete this->blobs;
+	delete this->output_data;
+}
+
+void moPeakFinderModule::clearBlobs() {
+	moDataGenericList::iterator it;
+	for ( it = this->blobs->begin(); it != this->blobs->end(); it++ )
+		delete (*it);
+	this->blobs->clear();
 }
 
-bool _sort_pred(const doubleToPoint &left, const doubleToPoint &right) {
-	return left.first > right.first;
+// stronger first, then first in reading order
+static bool _candidate_less(const peak_candidate_t &a, const peak_candidate_t &b) {
+	if ( a.value != b.value )
+		return a.value < b.value;
+	if ( a.y != b.y )
+		return a.y > b.y;
+	return a.x > b.x;
 }
 
-bool _in(std::vector<int> &vec, int e) {
-	for (unsigned int i = 0; i < vec.size(); i++) {
-		if (vec[i] == e) return true;
+// dst = max(a, b, c)
+static void _max_lines(unsigned char *dst, const unsigned char *a,
+					   const unsigned char *b, const unsigned char *c, int count) {
+	int x = 0;
+#ifdef __SSE2__
+	for ( ; x + 16 <= count; x += 16 ) {
+		__m128i m = _mm_max_epu8(_mm_loadu_si128((const __m128i *)(a + x)),
+								 _mm_loadu_si128((const __m128i *)(b + x)));
+		m = _mm_max_epu8(m, _mm_loadu_si128((const __m128i *)(c + x)));
+		_mm_storeu_si128((__m128i *)(dst + x), m);
+	}
+#endif
+	for ( ; x < count; x++ ) {
+		unsigned char m = a[x] > b[x] ? a[x] : b[x];
+		dst[x] = m > c[x] ? m : c[x];
 	}
-	return false;
 }
 
-void moPeakFinderModule::findRange(IplImage *src) {
-	// Find all pixels whose value is between min_value and max_value
-	// and consider it a peak.
-	int step = src->widthStep;
-	int height = src->height;
+void moPeakFinderModule::findCandidates(IplImage *src) {
 	int width = src->width;
+	int height = src->height;
+	int step = src->widthStep;
 	double min = this->property("min_value").asDouble();
 	double max = this->property("max_value").asDouble();
-	double cur_val;
-	char *data = src->imageData;
-
-	for (int i = 0; i < width; i++) {
-		for (int j = 0; j < height; j++) {
-			cur_val = ((int) data[j * step + i]);
-			if ((min < cur_val) && (cur_val < max)) {
-				doubleToPoint p;
-				p.first = cur_val;
-				p.second.x = i;
-				p.second.y = j;
-				this->peaks.push_back(p);
+	int low, high, x, y;
+	const unsigned char *above, *line, *below, *zero;
+	unsigned char *around;
+	unsigned char v, m;
+	peak_candidate_t candidate;
+
+	// ]min, max[ on integer values
+	low = (int)floor(min) + 1;
+	high = (int)ceil(max) - 1;
+	if ( low < 0 )
+		low = 0;
+	if ( high > 255 )
+		high = 255;
+	if ( low > high )
+		return;
+
+	// a line of zeros above and below the image, and on each side
+	this->column_max.assign(2 * (width + 2), 0);
+	zero = &this->column_max[width + 2];
+	around = &this->column_max[0];
+
+	for ( y = 0; y < height; y++ ) {
+		line = (const unsigned char *)src->imageData + y * step;
+		above = y > 0 ? line - step : zero;
+		below = y < height - 1 ? line + step : zero;
+		_max_lines(around + 1, above, line, below, width);
+
+		x = 0;
+#ifdef __SSE2__
+		{
+			// candidates: in range, and equal to the max of the 3x3 block
+			const __m128i vlow = _mm_set1_epi8((char)low);
+			const __m128i vhigh = _mm_set1_epi8((char)high);
+			for ( ; x + 16 <= width; x += 16 ) {
+				__m128i p = _mm_loadu_si128((const __m128i *)(line + x));
+				__m128i b = _mm_max_epu8(_mm_loadu_si128((const __m128i *)(around + x)),
+										 _mm_loadu_si128((const __m128i *)(around + x + 1)));
+				b = _mm_max_epu8(b, _mm_loadu_si128((const __m128i *)(around + x + 2)));
+				__m128i keep = _mm_cmpeq_epi8(p, b);
+				keep = _mm_and_si128(keep, _mm_cmpeq_epi8(_mm_max_epu8(p, vlow), p));
+				keep = _mm_and_si128(keep, _mm_cmpeq_epi8(_mm_min_epu8(p, vhigh), p));
+				int mask = _mm_movemask_epi8(keep);
+				while ( mask ) {
+					int i = __builtin_ctz(mask);
+					mask &= mask - 1;
+					// strictly greater than the neighbors before it
+					v = line[x + i];
+					if ( x + i > 0 && (line[x + i - 1] == v || above[x + i - 1] == v) )
+						continue;
+					if ( above[x + i] == v || (x + i + 1 < width && above[x + i + 1] == v) )
+						continue;
+					candidate.value = v;
+					candidate.x = x + i;
+					candidate.y = y;
+					this->candidates.push_back(candidate);
+				}
 			}
 		}
+#endif
+		for ( ; x < width; x++ ) {
+			v = line[x];
+			if ( v < low || v > high )
+				continue;
+			m = around[x] > around[x + 1] ? around[x] : around[x + 1];
+			m = m > around[x + 2] ? m : around[x + 2];
+			if ( v != m )
+				continue;
+			if ( x > 0 && (line[x - 1] == v || above[x - 1] == v) )
+				continue;
+			if ( above[x] == v || (x + 1 < width && above[x + 1] == v) )
+				continue;
+			candidate.value = v;
+			candidate.x = x;
+			candidate.y = y;
+			this->candidates.push_back(candidate);
+		}
 	}
 }
 
-void moPeakFinderModule::findMaxima() {
-	// If the max_peaks option was set, we only give back the $max_peaks strongest peaks.
+void moPeakFinderModule::selectPeaks(int width, int height) {
 	unsigned int max_peaks = this->property("max_peaks").asInteger();
-	if (max_peaks != 0 && max_peaks < this->peaks.size()) {
-		std::sort(this->peaks.begin(), this->peaks.end(), _sort_pred);
-		// We do so by erasing the weak peaks.
-		this->peaks.erase(this->peaks.begin()+max_peaks, this->peaks.end());
+	double merge = this->property("merge_distance").asDouble();
+	int cell, columns, rows, cx, cy, i, j, k, dx, dy;
+	bool close;
+	doubleToPoint peak;
+
+	// cells of merge_distance: the close peaks are in the 3x3 cells around
+	cell = merge > 1. ? (int)ceil(merge) : 1;
+	columns = (width + cell - 1) / cell;
+	rows = (height + cell - 1) / cell;
+	this->grid.assign(columns * rows, -1);
+	this->grid_next.clear();
+
+	// only the popped candidates are ordered
+	std::make_heap(this->candidates.begin(), this->candidates.end(), _candidate_less);
+	while ( !this->candidates.empty() ) {
+		if ( max_peaks != 0 && this->peaks.size() >= max_peaks )
+			break;
+		std::pop_heap(this->candidates.begin(), this->candidates.end(), _candidate_less);
+		peak_candidate_t &c = this->candidates.back();
+
+		cx = c.x / cell;
+		cy = c.y / cell;
+		close = false;
+		if ( merge > 0. ) {
+			for ( j = cy - 1; j <= cy + 1 && !close; j++ ) {
+				if ( j < 0 || j >= rows )
+					continue;
+				for ( i = cx - 1; i <= cx + 1 && !close; i++ ) {
+					if ( i < 0 || i >= columns )
+						continue;
+					for ( k = this->grid[j * columns + i]; k >= 0; k = this->grid_next[k] ) {
+						dx = (int)this->peaks[k].second.x - c.x;
+						dy = (int)this->peaks[k].second.y - c.y;
+						if ( dx * dx + dy * dy < merge * merge ) {
+							close = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if ( !close ) {
+			peak.first = c.value;
+			peak.second.x = c.x;
+			peak.second.y = c.y;
+			this->grid_next.push_back(this->grid[cy * columns + cx]);
+			this->grid[cy * columns + cx] = this->peaks.size();
+			this->peaks.push_back(peak);
+		}
+		this->candidates.pop_back();
 	}
 }
 
@@ -107,27 +259,42 @@ void moPeakFinderModule::drawPeaks() {
 }
 
 void moPeakFinderModule::applyFilter(IplImage *src) {
+	mo_frame_t data_frame = this->frame;
+	double x, y;
+
+	if ( src->depth != IPL_DEPTH_8U || src->nChannels != 1 ) {
+		this->setError("PeakFinder input image must be a single channel 8 bits image.");
+		this->stop();
+		return;
+	}
+
 	this->peaks.clear();
+	this->candidates.clear();
 
-	this->findRange(src);
-	this->findMaxima();
+	this->findCandidates(src);
+	this->selectPeaks(src->width, src->height);
 	this->drawPeaks();
 
 	// Push the peaks as blobs
-//	doubleToPoint peak;
-//	CvSize size = cvGetSize(src);
-//	for (unsigned int i = 0; i < this->peaks.size(); i++) {
-//		peak = peaks[i];
-//		moDataGenericContainer *blob = new moDataGenericContainer();
-//		blob->properties["type"] = new moProperty("blob");
-//		blob->properties["x"] = new moProperty(peak.second.x / size.width);
-//		blob->properties["y"] = new moProperty(peak.second.y / size.height);
-//		// We interpret the peak's value as its dimensions
-//		blob->properties["w"] = new moProperty(peak.first);
-//		blob->properties["h"] = new moProperty(peak.first);
-//		this->blobs->push_back(blob);
-//	}
-//	this->output_data->push(this->blobs);
+	this->clearBlobs();
+	for ( unsigned int i = 0; i < this->peaks.size(); i++ ) {
+		x = this->peaks[i].second.x / (double)src->width;
+		y = this->peaks[i].second.y / (double)src->height;
+		mo_frame_to_source(this->frame, x, y);
+
+		moDataGenericContainer *blob = new moDataGenericContainer();
+		blob->properties["type"] = new moProperty("blob");
+		blob->properties["x"] = new moProperty(x);
+		blob->properties["y"] = new moProperty(y);
+		// We interpret the peak's value as its dimensions
+		blob->properties["width"] = new moProperty(this->peaks[i].first);
+		blob->properties["height"] = new moProperty(this->peaks[i].first);
+		this->blobs->push_back(blob);
+	}
+
+	// positions are in the source frame now
+	mo_frame_reset_transform(data_frame);
+	this->output_data->push(this->blobs, data_frame);
 }
 
 moDataStream* moPeakFinderModule::getOutput(int n) {
@@ -135,3 +302,4 @@ moDataStream* moPeakFinderModule::getOutput(int n) {
 		return this->output_data;
 	return moImageFilterModule::getOutput(n);
 }
+
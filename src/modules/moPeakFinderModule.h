@@ -19,26 +19,42 @@
 #ifndef MO_PeakFinder_MODULE_H
 #define MO_PeakFinder_MODULE_H
 
+#include <vector>
 #include "moImageFilterModule.h"
 #include "../moDataGenericContainer.h"
 
 typedef std::pair<double, moPoint> doubleToPoint;
 
+typedef struct {
+	int value;
+	int x;
+	int y;
+} peak_candidate_t;
+
 class moPeakFinderModule : public moImageFilterModule{
 public:
 	moPeakFinderModule();
 	virtual ~moPeakFinderModule();
 
+	moDataStream* getOutput(int);
+
 protected:
 	std::vector<doubleToPoint> peaks;
 	moDataGenericList *blobs;
 	moDataStream *output_data;
-	void findRange(IplImage*);
-	void removeDuplicates();
-	void findMaxima();
+	void clearBlobs();
+	void findCandidates(IplImage*);
+	void selectPeaks(int width, int height);
 	void drawPeaks();
 	void applyFilter(IplImage*);
-	moDataStream* getOutput(int);
+
+	// local maximums of the frame, and the max of 3 lines around the
+	// current one (with a 0 on each side)
+	std::vector<peak_candidate_t> candidates;
+	std::vector<unsigned char> column_max;
+	// accepted peaks by cell of merge_distance, as linked lists
+	std::vector<int> grid;
+	std::vector<int> grid_next;
 
 	MODULE_INTERNALS();
 };
@@ -0,0 +1,252 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+//
+// Second half of a coarse to fine detection: blobs found on a Downscale
+// image are refined on the full resolution image. Only the pixels inside
+// each blob bounding box (scaled back, plus margin) are read, and the
+// blob get the centroid of the pixels above threshold, weighted by their
+// value over threshold. The input is not thresholded, so use the same
+// threshold than the coarse detection (50, as Threshold, by default).
+//
+// The full image must be the one of the same frame as the blobs, or the
+// blobs are passed with their coarse position.
+//
+
+#include <assert.h>
+
+#include "../moLog.h"
+#include "../moModule.h"
+#include "../moDataStream.h"
+#include "moRefineModule.h"
+
+MODULE_DECLARE(Refine, "native", "Refine blobs found on a downscaled image with the full image");
+
+moRefineModule::moRefineModule() : moModule(MO_MODULE_INPUT|MO_MODULE_OUTPUT, 2, 1) {
+	MODULE_INIT();
+
+	this->input_image = NULL;
+	this->input_blobs = NULL;
+	this->output = new moDataStream("GenericBlob");
+
+	this->input_infos[0] = new moDataStreamInfo(
+			"image", "IplImage", "Full resolution image (8 bits, one channel)");
+	this->input_infos[1] = new moDataStreamInfo(
+			"data", "GenericBlob", "Blobs found on the downscaled image");
+	this->output_infos[0] = new moDataStreamInfo(
+			"data", "GenericBlob", "Blobs with full resolution centroid");
+
+	// downscale factor of the image the blobs have been found on
+	this->properties["scale"] = new moProperty(2);
+	this->properties["scale"]->setMin(1);
+	this->properties["threshold"] = new moProperty(50);
+	this->properties["threshold"]->setMin(0);
+	this->properties["threshold"]->setMax(255);
+	// pixels added around the bounding box, -1 for scale
+	this->properties["margin"] = new moProperty(-1);
+	this->properties["margin"]->setMin(-1);
+}
+
+moRefineModule::~moRefineModule() {
+	this->clearBlobs();
+	delete this->output;
+}
+
+void moRefineModule::clearBlobs() {
+	moDataGenericList::iterator it;
+	for ( it = this->blobs.begin(); it != this->blobs.end(); it++ )
+		delete (*it);
+	this->blobs.clear();
+}
+
+void moRefineModule::notifyData(moDataStream *input) {
+	// the image come first, wait for the blobs
+	if ( input == this->input_blobs )
+		this->notifyUpdate();
+}
+
+void moRefineModule::refineBlob(IplImage *image, const mo_frame_t &image_frame, moDataGenericContainer *blob) {
+	int scale = this->property("scale").asInteger();
+	int threshold = this->property("threshold").asInteger();
+	int margin = this->property("margin").asInteger();
+	double cx, cy, w, h, sum = 0., sx = 0., sy = 0., weight;
+	int x0, y0, x1, y1, x, y, left, top, right, bottom;
+	const unsigned char *line;
+
+	if ( margin < 0 )
+		margin = scale;
+
+	w = blob->properties["width"]->asDouble() * scale;
+	h = blob->properties["height"]->asDouble() * scale;
+
+	// no image for this frame, only the size is converted
+	if ( image == NULL ) {
+		blob->properties["width"]->set(w);
+		blob->properties["height"]->set(h);
+		return;
+	}
+
+	// blobs are in the source frame, the image may be a part of it
+	cx = blob->properties["x"]->asDouble();
+	cy = blob->properties["y"]->asDouble();
+	mo_frame_from_source(image_frame, cx, cy);
+	cx *= image->width;
+	cy *= image->height;
+
+	x0 = (int)(cx - w / 2) - margin;
+	y0 = (int)(cy - h / 2) - margin;
+	x1 = (int)(cx + w / 2) + margin + 1;
+	y1 = (int)(cy + h / 2) + margin + 1;
+	if ( x0 < 0 ) x0 = 0;
+	if ( y0 < 0 ) y0 = 0;
+	if ( x1 > image->width ) x1 = image->width;
+	if ( y1 > image->height ) y1 = image->height;
+
+	left = x1; top = y1; right = x0 - 1; bottom = y0 - 1;
+	for ( y = y0; y < y1; y++ ) {
+		line = (const unsigned char *)image->imageData + y * image->widthStep;
+		for ( x = x0; x < x1; x++ ) {
+			if ( line[x] <= threshold )
+				continue;
+			weight = line[x] - threshold;
+			sum += weight;
+			sx += weight * x;
+			sy += weight * y;
+			if ( x < left ) left = x;
+			if ( x > right ) right = x;
+			if ( y < top ) top = y;
+			if ( y > bottom ) bottom = y;
+		}
+	}
+
+	// nothing there on the full image, keep the coarse blob
+	if ( sum <= 0. ) {
+		blob->properties["width"]->set(w);
+		blob->properties["height"]->set(h);
+		return;
+	}
+
+	// centroid of the pixels centers
+	cx = (sx / sum + 0.5) / image->width;
+	cy = (sy / sum + 0.5) / image->height;
+	mo_frame_to_source(image_frame, cx, cy);
+	blob->properties["x"]->set(cx);
+	blob->properties["y"]->set(cy);
+	blob->properties["width"]->set(right - left + 1);
+	blob->properties["height"]->set(bottom - top + 1);
+}
+
+void moRefineModule::update() {
+	moDataGenericList *coarse;
+	moDataGenericList::iterator it;
+	IplImage *image = NULL;
+	mo_frame_t frame, image_frame;
+
+	if ( this->input_blobs == NULL )
+		return;
+
+	this->input_blobs->lock();
+	coarse = static_cast<moDataGenericList *>(this->input_blobs->getData());
+	frame = this->input_blobs->getFrame();
+	if ( coarse == NULL ) {
+		this->input_blobs->unlock();
+		return;
+	}
+
+	this->clearBlobs();
+	for ( it = coarse->begin(); it != coarse->end(); it++ )
+		this->blobs.push_back((*it)->clone());
+	this->input_blobs->unlock();
+
+	if ( this->input_image != NULL ) {
+		this->input_image->lock();
+		image = static_cast<IplImage *>(this->input_image->getData());
+		image_frame = this->input_image->getFrame();
+
+		if ( image != NULL && ( image->nChannels != 1 || image->depth != IPL_DEPTH_8U ) ) {
+			this->input_image->unlock();
+			this->setError("Refine input image must be a single channel 8 bits image.");
+			return;
+		}
+
+		if ( image != NULL && image_frame.id != frame.id ) {
+			LOGM(MO_DEBUG, "image of frame " << image_frame.id
+				<< " doesn't match blobs of frame " << frame.id << ", not refined");
+			image = NULL;
+		}
+
+		for ( it = this->blobs.begin(); it != this->blobs.end(); it++ )
+			this->refineBlob(image, image_frame, *it);
+		this->input_image->unlock();
+	} else {
+		for ( it = this->blobs.begin(); it != this->blobs.end(); it++ )
+			this->refineBlob(NULL, frame, *it);
+	}
+
+	this->output->push(&this->blobs, frame);
+}
+
+void moRefineModule::setInput(moDataStream *stream, int n) {
+	if ( n != 0 && n != 1 ) {
+		this->setError("Invalid input index");
+		return;
+	}
+
+	if ( n == 0 ) {
+		if ( this->input_image != NULL )
+			this->input_image->removeObserver(this);
+		this->input_image = stream;
+		if ( stream != NULL && stream->getFormat() != "IplImage" ) {
+			this->setError("Input 0 accept only IplImage");
+			this->input_image = NULL;
+			return;
+		}
+	} else {
+		if ( this->input_blobs != NULL )
+			this->input_blobs->removeObserver(this);
+		this->input_blobs = stream;
+		if ( stream != NULL && stream->getFormat() != "GenericBlob" ) {
+			this->setError("Input 1 accept only GenericBlob");
+			this->input_blobs = NULL;
+			return;
+		}
+	}
+
+	if ( stream != NULL )
+		stream->addObserver(this);
+}
+
+moDataStream *moRefineModule::getInput(int n) {
+	if ( n == 0 )
+		return this->input_image;
+	if ( n == 1 )
+		return this->input_blobs;
+
+	this->setError("Invalid input index");
+	return NULL;
+}
+
+moDataStream *moRefineModule::getOutput(int n) {
+	if ( n != 0 ) {
+		this->setError("Invalid output index");
+		return NULL;
+	}
+	return this->output;
+}
+
@@ -0,0 +1,54 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+
+#ifndef MO_REFINE_MODULE_H
+#define MO_REFINE_MODULE_H
+
+#include "../moModule.h"
+#include "../moDataGenericContainer.h"
+#include "cv.h"
+
+class moDataStream;
+
+class moRefineModule : public moModule {
+public:
+	moRefineModule();
+	virtual ~moRefineModule();
+
+	virtual void setInput(moDataStream* stream, int n=0);
+	virtual moDataStream *getInput(int n=0);
+	virtual moDataStream *getOutput(int n=0);
+	virtual void notifyData(moDataStream *input);
+
+	void update();
+
+private:
+	moDataStream *input_image;
+	moDataStream *input_blobs;
+	moDataStream *output;
+	moDataGenericList blobs;
+
+	void clearBlobs();
+	void refineBlob(IplImage *image, const mo_frame_t &image_frame, moDataGenericContainer *blob);
+
+	MODULE_INTERNALS();
+};
+
+#endif
+
@@ -16,11 +16,19 @@
  **********************************************************************/
 
 
+//
+// Crop the image without copying it: the output is a header pointing into
+// the input image, valid as long as the input image is. The crop is added
+// to the frame transform, so the modules after it report positions in the
+// source frame.
+//
+
+#include <string.h>
 #include "moRoiModule.h"
 #include "../moLog.h"
 #include "cv.h"
 
-MODULE_DECLARE(Roi, "native", "Roi filter");
+MODULE_DECLARE(Roi, "native", "Crop the image (no copy)");
 
 moRoiModule::moRoiModule() : moImageFilterModule(){
 
@@ -32,16 +40,38 @@ moRoiModule::moRoiModule() : moImageFilterModule(){
 	this->properties["width"] = new moProperty(200);
 	this->properties["height"] = new moProperty(100);
 
+	memset(&this->view, 0, sizeof(this->view));
 }
 
 moRoiModule::~moRoiModule() {
 }
 
+void moRoiModule::allocateBuffers() {
+	// nothing to allocate, the output point into the input
+}
+
 void moRoiModule::applyFilter(IplImage *src) {
+	// not used, see update()
+}
+
+void moRoiModule::update() {
+	IplImage *src;
 	int left	= this->property("left").asInteger(),
 		top		= this->property("top").asInteger(),
 		width	= this->property("width").asInteger(),
-		height	= this->property("height").asInteger();
+		height	= this->property("height").asInteger(),
+		pixel;
+
+	if ( this->input == NULL )
+		return;
+
+	this->input->lock();
+
+	src = static_cast<IplImage *>(this->input->getData());
+	if ( src == NULL ) {
+		this->input->unlock();
+		return;
+	}
 
 	if ( left < 0 )
 		left = 0;
@@ -60,9 +90,30 @@ void moRoiModule::applyFilter(IplImage *src) {
 	if ( (top + height) > src->height )
 		height = src->height - top;
 
-	cvSetImageROI(src, cvRect(left, top, width, height));
-	cvSetImageROI(this->output_buffer, cvRect(left, top, width, height));
-	cvCopy(src, this->output_buffer, NULL);
-}
+	if ( width == 0 || height == 0 ) {
+		this->input->unlock();
+		LOGM(MO_WARNING, "empty region, nothing to output");
+		return;
+	}
+
+	cvInitImageHeader(&this->view, cvSize(width, height), src->depth,
+		src->nChannels, src->origin, src->align);
+
+	// same lines than the input, starting at the region. imageSize stop
+	// at the end of the last pixel, so copies don't read after the input.
+	pixel = src->nChannels * ((src->depth & 255) >> 3);
+	this->view.widthStep = src->widthStep;
+	this->view.imageSize = src->widthStep * (height - 1) + width * pixel;
+	this->view.imageData = src->imageData + top * src->widthStep + left * pixel;
+	this->view.imageDataOrigin = NULL;
 
+	this->frame = this->input->getFrame();
+	mo_frame_crop(this->frame,
+		left / (double)src->width, top / (double)src->height,
+		width / (double)src->width, height / (double)src->height);
+
+	this->input->unlock();
+
+	this->output->push(&this->view, this->frame);
+}
 
@@ -26,9 +26,14 @@ public:
 	moRoiModule();
 	virtual ~moRoiModule();
 	
+	virtual void update();
+
 protected:
+	// header pointing into the input image
+	IplImage view;
+
 	void applyFilter(IplImage *);
-	int size;
+	void allocateBuffers();
 	MODULE_INTERNALS();
 };
 
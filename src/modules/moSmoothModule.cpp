@@ -16,7 +16,16 @@
  **********************************************************************/
 
 
+//
+// Besides the cvSmooth filters, "box" is a box blur done with running sums,
+// and "recursive_gaussian" is the Young - van Vliet recursive gaussian
+// with the sigma cvSmooth would use for the same size. The cost of both
+// doesn't depend on the size.
+//
+
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 #include "moSmoothModule.h"
 #include "../moLog.h"
 #include "cv.h"
@@ -32,7 +41,7 @@ moSmoothModule::moSmoothModule() : moImageFilterModule(){
 	this->properties["size"]->setMin(0);
 	this->properties["size"]->setMax(50);
 	this->properties["filter"] = new moProperty("gaussian");
-	this->properties["filter"]->setChoices("median;gaussian;blur;blur_no_scale");
+	this->properties["filter"]->setChoices("median;gaussian;blur;blur_no_scale;box;recursive_gaussian");
 }
 
 moSmoothModule::~moSmoothModule() {
@@ -53,7 +62,164 @@ int moSmoothModule::toCvType(const std::string &filter) {
 	return 0;
 }
 
+void moSmoothModule::boxFilter(IplImage *src, int radius) {
+	int count = src->width * src->nChannels;
+	int area, half;
+	const unsigned int *sums;
+	unsigned char *out;
+
+	this->box.start(src, radius);
+	area = this->box.getArea();
+	half = area / 2;
+
+	for ( int y = 0; y < src->height; y++ ) {
+		if ( y > 0 )
+			this->box.next();
+		sums = this->box.getLine();
+		out = (unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep;
+		for ( int x = 0; x < count; x++ )
+			out[x] = (sums[x] + half) / area;
+	}
+}
+
+// Backward pass initial state for a border replicated to infinity (Triggs
+// and Sdika): it is linear in the last forward outputs minus the border
+// value, the matrix is found by running both filters on a long tail.
+static void _boundary_matrix(double B, double b1, double b2, double b3, int length, double *M) {
+	std::vector<double> tail(length + 3);
+	double w, w1, w2, w3;
+	int i, j, k;
+
+	for ( j = 0; j < 3; j++ ) {
+		w1 = j == 0 ? 1. : 0.;
+		w2 = j == 1 ? 1. : 0.;
+		w3 = j == 2 ? 1. : 0.;
+		for ( k = 0; k < length; k++ ) {
+			w = b1 * w1 + b2 * w2 + b3 * w3;
+			tail[k] = w;
+			w3 = w2; w2 = w1; w1 = w;
+		}
+		tail[length] = tail[length + 1] = tail[length + 2] = 0.;
+		for ( k = length - 1; k >= 0; k-- )
+			tail[k] = B * tail[k] + b1 * tail[k + 1] + b2 * tail[k + 2] + b3 * tail[k + 3];
+		for ( i = 0; i < 3; i++ )
+			M[i * 3 + j] = tail[i];
+	}
+}
+
+void moSmoothModule::recursiveGaussian(IplImage *src, double sigma) {
+	int channels = src->nChannels;
+	int count = src->width * channels;
+	int height = src->height;
+	int last1, last2, last3;
+	double q, b0, b1, b2, b3, B, M[9];
+	float *line, *prev1, *prev2, *prev3, *edge;
+	float u, d1, d2, d3;
+	unsigned char *out;
+	const unsigned char *in;
+	int x, y, c, i;
+
+	// Young - van Vliet coefficients
+	if ( sigma < 0.5 )
+		sigma = 0.5;
+	if ( sigma >= 2.5 )
+		q = 0.98711 * sigma - 0.96330;
+	else
+		q = 3.97156 - 4.14554 * sqrt(1. - 0.26891 * sigma);
+	b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+	b1 = (2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q) / b0;
+	b2 = -(1.4281 * q * q + 1.26661 * q * q * q) / b0;
+	b3 = (0.422205 * q * q * q) / b0;
+	B = 1. - (b1 + b2 + b3);
+	_boundary_matrix(B, b1, b2, b3, (int)(10. * sigma) + 50, M);
+
+	// 3 more lines: the backward state below the image, and the last line
+	// before the vertical forward pass
+	this->buffer.resize(count * (height + 4));
+	edge = &this->buffer[count * (height + 3)];
+
+	// horizontal, forward then backward on each line, borders replicated
+	last1 = count - channels;
+	last2 = count - (src->width > 1 ? 2 : 1) * channels;
+	last3 = count - (src->width > 2 ? 3 : src->width) * channels;
+	for ( y = 0; y < height; y++ ) {
+		in = (const unsigned char *)src->imageData + y * src->widthStep;
+		line = &this->buffer[y * count];
+		for ( c = 0; c < channels; c++ ) {
+			float w1 = in[c], w2 = in[c], w3 = in[c], w;
+			for ( x = c; x < count; x += channels ) {
+				w = B * in[x] + b1 * w1 + b2 * w2 + b3 * w3;
+				line[x] = w;
+				w3 = w2; w2 = w1; w1 = w;
+			}
+			u = in[last1 + c];
+			d1 = line[last1 + c] - u;
+			d2 = line[last2 + c] - u;
+			d3 = line[last3 + c] - u;
+			w1 = u + M[0] * d1 + M[1] * d2 + M[2] * d3;
+			w2 = u + M[3] * d1 + M[4] * d2 + M[5] * d3;
+			w3 = u + M[6] * d1 + M[7] * d2 + M[8] * d3;
+			for ( x = last1 + c; x >= 0; x -= channels ) {
+				w = B * line[x] + b1 * w1 + b2 * w2 + b3 * w3;
+				line[x] = w;
+				w3 = w2; w2 = w1; w1 = w;
+			}
+		}
+	}
+
+	// vertical, on whole lines to stay in the cache
+	memcpy(edge, &this->buffer[(height - 1) * count], count * sizeof(float));
+	for ( y = 0; y < height; y++ ) {
+		line = &this->buffer[y * count];
+		prev1 = &this->buffer[(y > 0 ? y - 1 : 0) * count];
+		prev2 = &this->buffer[(y > 1 ? y - 2 : 0) * count];
+		prev3 = &this->buffer[(y > 2 ? y - 3 : 0) * count];
+		for ( x = 0; x < count; x++ )
+			line[x] = B * line[x] + b1 * prev1[x] + b2 * prev2[x] + b3 * prev3[x];
+	}
+
+	prev1 = &this->buffer[(height - 1) * count];
+	prev2 = &this->buffer[(height > 1 ? height - 2 : height - 1) * count];
+	prev3 = &this->buffer[(height > 2 ? height - 3 : 0) * count];
+	for ( i = 0; i < 3; i++ ) {
+		line = &this->buffer[(height + i) * count];
+		for ( x = 0; x < count; x++ )
+			line[x] = edge[x] + M[i * 3] * (prev1[x] - edge[x])
+				+ M[i * 3 + 1] * (prev2[x] - edge[x]) + M[i * 3 + 2] * (prev3[x] - edge[x]);
+	}
+
+	for ( y = height - 1; y >= 0; y-- ) {
+		line = &this->buffer[y * count];
+		prev1 = line + count;
+		prev2 = prev1 + count;
+		prev3 = prev2 + count;
+		out = (unsigned char *)this->output_buffer->imageData + y * this->output_buffer->widthStep;
+		for ( x = 0; x < count; x++ ) {
+			line[x] = B * line[x] + b1 * prev1[x] + b2 * prev2[x] + b3 * prev3[x];
+			out[x] = line[x] <= 0.f ? 0 : (line[x] >= 255.f ? 255 : (unsigned char)(line[x] + 0.5f));
+		}
+	}
+}
+
 void moSmoothModule::applyFilter(IplImage *src) {
+	std::string filter = this->property("filter").asString();
+	int size = this->property("size").asInteger();
+
+	if ( filter == "box" || filter == "recursive_gaussian" ) {
+		if ( src->depth != IPL_DEPTH_8U ) {
+			this->setError("box and recursive_gaussian filters need a 8 bits image");
+			return;
+		}
+		if ( filter == "box" )
+			this->boxFilter(src, size);
+		else if ( size <= 0 )
+			cvCopy(src, this->output_buffer);
+		else
+			// sigma of cvSmooth for a (size * 2 + 1) gaussian
+			this->recursiveGaussian(src, 0.3 * (size - 1) + 0.8);
+		return;
+	}
+
 	cvSmooth(
 		src,
 		this->output_buffer,
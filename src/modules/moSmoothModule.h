@@ -19,7 +19,9 @@
 #ifndef MO_SMOOTH_MODULE_H
 #define MO_SMOOTH_MODULE_H
 
+#include <vector>
 #include "moImageFilterModule.h"
+#include "../moBoxSums.h"
 
 class moSmoothModule : public moImageFilterModule{
 public:
@@ -29,8 +31,14 @@ public:
 protected:
 	void applyFilter(IplImage *);
 	int toCvType(const std::string&);
+	void boxFilter(IplImage *src, int radius);
+	void recursiveGaussian(IplImage *src, double sigma);
 	int width, height;
 
+	moBoxSums box;
+	// recursive gaussian intermediate lines
+	std::vector<float> buffer;
+
 	MODULE_INTERNALS();
 };
 
@@ -16,14 +16,124 @@
  **********************************************************************/
 
 
+//
+// Adaptive threshold compare each pixel to the mean of its block_size
+// neighborhood. With mode "integral", the mean is read from a summed area
+// table built once per frame, the cost doesn't depend on block_size. The
+// table is built and applied by "threads" threads. Near the borders, the
+// mean is taken on the part of the block inside the image.
+//
+
 #include <assert.h>
+#include <math.h>
 #include "moThresholdModule.h"
 #include "../moLog.h"
 #include "cv.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 MODULE_DECLARE(Threshold, "native", "Thresholding to throw away all values below or above certain threshold");
 
-moThresholdModule::moThresholdModule() : moImageFilterModule(){
+typedef struct {
+	IplImage *src;
+	IplImage *dst;
+	unsigned int *integral;
+	int pass;
+	int half;
+	int threshold;
+	bool inverse;
+} integral_job_t;
+
+// pass 0: sum of each line, split by rows
+static void _integral_lines(integral_job_t *job, int first, int end) {
+	IplImage *src = job->src;
+	int stride = src->width + 1;
+	unsigned int sum, *line;
+	const unsigned char *pixels;
+
+	for ( int y = first; y < end; y++ ) {
+		pixels = (const unsigned char *)src->imageData + y * src->widthStep;
+		line = job->integral + (y + 1) * stride;
+		line[0] = sum = 0;
+		for ( int x = 0; x < src->width; x++ ) {
+			sum += pixels[x];
+			line[x + 1] = sum;
+		}
+	}
+}
+
+// pass 1: accumulate the lines from top to bottom, split by columns
+static void _integral_columns(integral_job_t *job, int first, int end) {
+	int stride = job->src->width + 1;
+	unsigned int *above, *line;
+	int x;
+
+	for ( int y = 2; y <= job->src->height; y++ ) {
+		above = job->integral + (y - 1) * stride;
+		line = above + stride;
+		x = first;
+#ifdef __SSE2__
+		for ( ; x + 4 <= end; x += 4 ) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(above + x));
+			__m128i b = _mm_loadu_si128((const __m128i *)(line + x));
+			_mm_storeu_si128((__m128i *)(line + x), _mm_add_epi32(a, b));
+		}
+#endif
+		for ( ; x < end; x++ )
+			line[x] += above[x];
+	}
+}
+
+// pass 2: compare each pixel to the mean of its block, split by rows
+static void _integral_threshold(integral_job_t *job, int first, int end) {
+	IplImage *src = job->src;
+	int stride = src->width + 1;
+	int x0, x1, y0, y1, count, sum;
+	const unsigned int *top, *bottom;
+	const unsigned char *pixels;
+	unsigned char *out, pass, fail;
+
+	pass = job->inverse ? 0 : 255;
+	fail = job->inverse ? 255 : 0;
+
+	for ( int y = first; y < end; y++ ) {
+		pixels = (const unsigned char *)src->imageData + y * src->widthStep;
+		out = (unsigned char *)job->dst->imageData + y * job->dst->widthStep;
+		y0 = y - job->half < 0 ? 0 : y - job->half;
+		y1 = y + job->half + 1 > src->height ? src->height : y + job->half + 1;
+		top = job->integral + y0 * stride;
+		bottom = job->integral + y1 * stride;
+		for ( int x = 0; x < src->width; x++ ) {
+			x0 = x - job->half < 0 ? 0 : x - job->half;
+			x1 = x + job->half + 1 > src->width ? src->width : x + job->half + 1;
+			count = (x1 - x0) * (y1 - y0);
+			sum = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+			// pixel > mean + threshold, without division
+			out[x] = pixels[x] * count > sum + job->threshold * count ? pass : fail;
+		}
+	}
+}
+
+static void _integral_pass(void *userdata, int index, int count) {
+	integral_job_t *job = (integral_job_t *)userdata;
+	int size;
+
+	if ( job->pass == 1 ) {
+		size = job->src->width + 1;
+		_integral_columns(job, size * index / count, size * (index + 1) / count);
+		return;
+	}
+
+	size = job->src->height;
+	if ( job->pass == 0 )
+		_integral_lines(job, size * index / count, size * (index + 1) / count);
+	else
+		_integral_threshold(job, size * index / count, size * (index + 1) / count);
+}
+
+moThresholdModule::moThresholdModule() : moLutModule(){
 
 	MODULE_INIT();
 
@@ -35,7 +145,11 @@ moThresholdModule::moThresholdModule() : moImageFilterModule(){
 	this->properties["block_size"] = new moProperty(21); // size fo neighbor hood to compare to for adaptive threshold
 
 	this->properties["mode"] = new moProperty("mean");
-	this->properties["mode"]->setChoices("mean;gaussian");
+	this->properties["mode"]->setChoices("mean;gaussian;integral");
+
+	this->properties["threads"] = new moProperty(1);
+	this->properties["threads"]->setMin(1);
+	this->properties["threads"]->setMax(16);
 
 	this->properties["type"] = new moProperty("binary");
 	this->properties["type"]->setChoices("binary;binary_inv;trunc;tozero;tozero_inv");
@@ -47,6 +161,7 @@ moThresholdModule::~moThresholdModule()
 }
 
 void moThresholdModule::stop() {
+	this->pool.clear();
 	moImageFilterModule::stop();
 
 	if ( this->output_buffer != NULL ) {
@@ -99,9 +214,40 @@ int moThresholdModule::getCvMode(const std::string &filter)
 	return 0;
 }
 
-void moThresholdModule::applyFilter(IplImage *)
+// the fixed threshold is a table, the adaptive ones are not
+bool moThresholdModule::acceptLut(IplImage *src) {
+	return src->depth == IPL_DEPTH_8U && src->nChannels == 1
+		&& !this->property("adaptive").asBool();
+}
+
+void moThresholdModule::buildLut(unsigned char *lut) {
+	// as cvThreshold on 8 bits images
+	int threshold = (int)floor(this->property("threshold").asDouble());
+	int type = this->getCvType(this->property("type").asString());
+
+	for ( int i = 0; i < 256; i++ ) {
+		switch ( type ) {
+			case CV_THRESH_BINARY:
+				lut[i] = i > threshold ? 255 : 0;
+				break;
+			case CV_THRESH_BINARY_INV:
+				lut[i] = i > threshold ? 0 : 255;
+				break;
+			case CV_THRESH_TRUNC:
+				lut[i] = i > threshold ? threshold : i;
+				break;
+			case CV_THRESH_TOZERO:
+				lut[i] = i > threshold ? i : 0;
+				break;
+			case CV_THRESH_TOZERO_INV:
+				lut[i] = i > threshold ? 0 : i;
+				break;
+		}
+	}
+}
+
+void moThresholdModule::applyFilter(IplImage *src)
 {
-	IplImage* src = static_cast<IplImage*>(this->input->getData());
 
 	if ( src->nChannels != 1 ) {
 		this->setError("Threshold input image must be a single channel binary image.");
@@ -119,6 +265,12 @@ void moThresholdModule::applyFilter(IplImage *)
 			block_size++;
 		}
 
+		if ( this->property("mode").asString() == "integral" ) {
+			this->integralThreshold(src, block_size,
+				this->getCvAdaptativeType(this->property("type").asString()) == CV_THRESH_BINARY_INV);
+			return;
+		}
+
 		cvAdaptiveThreshold(
 			src,
 			this->output_buffer,
@@ -142,4 +294,28 @@ void moThresholdModule::applyFilter(IplImage *)
 
 }
 
+void moThresholdModule::integralThreshold(IplImage *src, int block_size, bool inverse) {
+	integral_job_t job;
+
+	if ( src->depth != IPL_DEPTH_8U ) {
+		this->setError("Threshold integral mode need a 8 bits image.");
+		this->stop();
+		return;
+	}
+
+	// first line and column stay at 0
+	if ( this->integral.size() != (unsigned int)((src->width + 1) * (src->height + 1)) )
+		this->integral.assign((src->width + 1) * (src->height + 1), 0);
+
+	job.src = src;
+	job.dst = this->output_buffer;
+	job.integral = &this->integral[0];
+	job.half = block_size / 2;
+	job.threshold = this->property("threshold").asInteger();
+	job.inverse = inverse;
+
+	this->pool.setThreads(this->property("threads").asInteger());
+	for ( job.pass = 0; job.pass < 3; job.pass++ )
+		this->pool.run(_integral_pass, &job);
+}
 
@@ -19,19 +19,28 @@
 #ifndef MO_THRESHOLD_MODULE_H
 #define MO_THRESHOLD_MODULE_H
 
-#include "moImageFilterModule.h"
+#include <vector>
+#include "moLutModule.h"
+#include "../moWorkerPool.h"
 
-class moThresholdModule : public moImageFilterModule{
+class moThresholdModule : public moLutModule{
 public:
 	moThresholdModule();
 	virtual ~moThresholdModule();
 	
 protected:
 	void applyFilter(IplImage *);
+	bool acceptLut(IplImage *src);
+	void buildLut(unsigned char *lut);
 	void stop();
 	int getCvType(const std::string &filter);
 	int getCvAdaptativeType(const std::string &filter);
 	int getCvMode(const std::string &filter);
+	void integralThreshold(IplImage *src, int block_size, bool inverse);
+
+	// summed area table of the frame, for the integral mode
+	std::vector<unsigned int> integral;
+	moWorkerPool pool;
 	
 	MODULE_INTERNALS();
 };
@@ -26,6 +26,24 @@
 //
 //  /tuio/2Dobj set s i x y a X Y A m r
 //  /tuio/2Dcur set s x y X Y m
+//  /tuio/2Dblb set s x y a w h f X Y A m r
+//
+// The module have 3 inputs: "data" (touch as 2Dcur, or fiducial as
+// 2Dobj), "fiducial" (2Dobj) and "blob" (2Dblb). When several inputs are
+// connected and "sync" is set, the module wait for all of them to deliver
+// the same frame id, or after "timeout" seconds use the latest ones if
+// "fallback" is "latest", and send all the profiles in the same bundle,
+// sharing the same fseq. Without sync, every new data is sent.
+// The frame is encoded once, and sent to ip:port and to every host:port
+// of the destinations property (comma separated). With timetag, bundles
+// are stamped with the time of the frame instead of "immediately", which
+// allow the receiver (see TuioProbe) to measure the latency.
+//
+// Frames bigger than the mtu property are splitted in several bundles,
+// each one with the alive and fseq messages. With delta, set messages of
+// objects that didn't change are skipped (all of them are sent again
+// every delta_refresh frames). sendsize append w h to 2Dcur, which is
+// not part of the specification.
 //
 // Table 1: semantic types of set messages
 // s 		Session ID (temporary object ID) 	int32
@@ -43,178 +61,423 @@
 
 
 #include <sstream>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "moTuioModule.h"
 #include "../moLog.h"
+#include "../moUtils.h"
 #include "../moDataGenericContainer.h"
 #include "../moDataStream.h"
 #include "../moOSC.h"
+#include "../moOSCPacket.h"
 
 MODULE_DECLARE(Tuio, "native", "Convert stream to TUIO format (touch & fiducial)");
 
-moTuioModule::moTuioModule() : moModule(MO_MODULE_INPUT, 1, 0) {
+// motion properties are optional, only trackers that estimate them set them
+static float _motion(moDataGenericContainer *obj, const std::string &name) {
+	if ( !obj->exist(name) )
+		return 0.;
+	return (float)obj->properties[name]->asDouble();
+}
+
+// blob size is either normalized (w/h) or in pixels (width/height)
+static float _size(moDataGenericContainer *obj, const std::string &name, const std::string &fallback) {
+	if ( obj->exist(name) )
+		return (float)obj->properties[name]->asDouble();
+	if ( obj->exist(fallback) )
+		return (float)obj->properties[fallback]->asDouble();
+	return 0.;
+}
+
+// blob orientation is optional, not every blob source estimate it
+static float _angle(moDataGenericContainer *obj) {
+	if ( !obj->exist("angle") )
+		return 0.;
+	return (float)obj->properties["angle"]->asDouble();
+}
+
+// fiducials from a tracker carry a session id, otherwise use the class id
+static int _session(moDataGenericContainer *obj) {
+	if ( obj->exist("session_id") )
+		return obj->properties["session_id"]->asInteger();
+	return obj->properties["id"]->asInteger();
+}
+
+moTuioModule::moTuioModule() : moModule(MO_MODULE_INPUT, TUIO_INPUT_COUNT, 0) {
 
 	MODULE_INIT();
 
-	this->input = NULL;
-	this->osc	= NULL;
+	for ( int i = 0; i < TUIO_INPUT_COUNT; i++ ) {
+		this->inputs[i] = NULL;
+	}
 	this->fseq	= 0;
 
 	// declare inputs
 	this->input_infos[0] = new moDataStreamInfo(
 			"data", "moDataGenericList", "Data stream with type of 'touch' or 'fiducial'");
+	this->input_infos[1] = new moDataStreamInfo(
+			"fiducial", "moDataGenericList", "Data stream with type of 'fiducial', sent as 2Dobj");
+	this->input_infos[2] = new moDataStreamInfo(
+			"blob", "moDataGenericList", "Data stream with type of 'blob', sent as 2Dblb");
 
 	// declare properties
 	this->properties["ip"] = new moProperty("127.0.0.1");
 	this->properties["port"] = new moProperty(3333);
-	this->properties["sendsize"] = new moProperty(true);
+	this->properties["destinations"] = new moProperty("");
+	this->properties["sendsize"] = new moProperty(false);
+	this->properties["mtu"] = new moProperty(1472);
+	this->properties["mtu"]->setMin(128);
+	this->properties["mtu"]->setMax(65507);
+	this->properties["delta"] = new moProperty(false);
+	this->properties["delta_refresh"] = new moProperty(30);
+	this->properties["delta_refresh"]->setMin(0);
+	this->properties["timetag"] = new moProperty(false);
+	this->properties["sync"] = new moProperty(true);
+	this->properties["timeout"] = new moProperty(0.1);
+	this->properties["timeout"]->setMin(0);
+	this->properties["fallback"] = new moProperty("latest");
+	this->properties["fallback"]->setChoices("latest;skip");
 }
 
 moTuioModule::~moTuioModule(){
-	if ( this->osc != NULL )
-		delete this->osc;
+	this->closeDestinations();
 }
 
 void moTuioModule::start() {
-	this->osc = new moOSC(
+	std::vector<std::string> destinations;
+	std::vector<std::string>::iterator it;
+	std::string::size_type sep;
+
+	this->closeDestinations();
+
+	this->osc.push_back(new moOSC(
 		this->property("ip").asString(),
 		this->property("port").asInteger()
-	);
+	));
+
+	destinations = moUtils::tokenize(this->property("destinations").asString(), ", ");
+	for ( it = destinations.begin(); it != destinations.end(); it++ ) {
+		if ( it->empty() )
+			continue;
+		sep = it->rfind(':');
+		if ( sep == std::string::npos ) {
+			LOGM(MO_ERROR, "invalid destination " << *it << ", must be host:port");
+			continue;
+		}
+		this->osc.push_back(new moOSC(it->substr(0, sep),
+			atoi(it->substr(sep + 1).c_str())));
+	}
+
+	this->join.reset();
+
 	moModule::start();
 }
 
 void moTuioModule::stop() {
 	moModule::stop();
-	delete this->osc;
-	this->osc = NULL;
+	this->closeDestinations();
+}
+
+void moTuioModule::closeDestinations() {
+	std::vector<moOSC *>::iterator it;
+	for ( it = this->osc.begin(); it != this->osc.end(); it++ )
+		delete (*it);
+	this->osc.clear();
+}
+
+// index of each connected input in the join, -1 if not connected
+int moTuioModule::joinInputs(int *index) {
+	int n, count = 0;
+	for ( n = 0; n < TUIO_INPUT_COUNT; n++ )
+		index[n] = this->inputs[n] != NULL ? count++ : -1;
+	this->join.setInputs(count);
+	return count;
 }
 
 void moTuioModule::notifyData(moDataStream *input) {
-	WOscBundle	*bundle = NULL;
+	int index[TUIO_INPUT_COUNT];
+	mo_frame_t frame;
+	bool ready;
+	int n;
 
 	assert( input != NULL );
-	assert( input == this->input );
 
-	// out input have been updated !
-	this->input->lock();
+	if ( this->osc.empty() )
+		return;
 
-	if ( input->getFormat() == "GenericFiducial" ) {
+	if ( this->joinInputs(index) <= 1 || !this->property("sync").asBool() ) {
+		this->send();
+		return;
+	}
 
-		bundle = new WOscBundle();
-		WOscMessage *msg = new WOscMessage("/tuio/2Dobj");
-		msg->Add("alive");
+	input->lock();
+	frame = input->getFrame();
+	input->unlock();
+
+	// the same stream can be connected on several inputs
+	this->join.setTimeout(this->property("timeout").asDouble(),
+		this->property("fallback").asString() == "latest");
+	ready = false;
+	for ( n = 0; n < TUIO_INPUT_COUNT; n++ ) {
+		if ( this->inputs[n] == input && this->join.notify(index[n], frame) )
+			ready = true;
+	}
+	if ( ready )
+		this->send();
+}
 
-		moDataGenericList::iterator it;
-		moDataGenericList *list = (moDataGenericList *)this->input->getData();
-		for ( it = list->begin(); it != list->end(); it++ ) {
-			assert((*it)->properties["type"]->asString() == "fiducial");
-			msg->Add(atoi((*it)->properties["id"]->asString().c_str()));
-		}
+void moTuioModule::poll() {
+	int index[TUIO_INPUT_COUNT];
 
-		bundle->Add(msg);
+	// a frame that never complete
+	this->lock();
+	if ( !this->osc.empty() && this->joinInputs(index) > 1
+		 && this->property("sync").asBool() && this->join.expired() )
+		this->send();
+	this->unlock();
 
-		for ( it = list->begin(); it != list->end(); it++ ) {
-			assert((*it)->properties["type"]->asString() == "fiducial");
-			msg = new WOscMessage("/tuio/2Dobj");
-			msg->Add("set");
-			msg->Add(9843); // session id
-			msg->Add((*it)->properties["id"]->asInteger()); // class id
-			msg->Add((float)(*it)->properties["x"]->asDouble()); // x
-			msg->Add((float)(*it)->properties["y"]->asDouble()); // y
-			msg->Add((float)(*it)->properties["angle"]->asDouble()); // a
-			msg->Add((float)0.); // X
-			msg->Add((float)0.); // Y
-			msg->Add((float)0.); // A
-			msg->Add((float)0.); // m
-			msg->Add((float)0.); // r
-			bundle->Add(msg);
-		}
+	moModule::poll();
+}
+
+void moTuioModule::send() {
+	std::vector<moOSC *>::iterator it;
+	double timetag;
+	unsigned int i;
+	int n;
 
-		msg = new WOscMessage("/tuio/2Dobj");
-		msg->Add("fseq");
-		msg->Add(this->fseq++);
-		bundle->Add(msg);
+	this->encoder.setMTU(this->property("mtu").asInteger());
+	this->encoder.setDelta(this->property("delta").asBool(),
+		this->property("delta_refresh").asInteger());
 
+	this->lockInputs();
 
-	} else if ( input->getFormat() == "GenericBlob" ) {
-		// /tuio/2Dcur set s x y X Y m
+	this->cur_lists.clear();
+	this->obj_lists.clear();
+	this->blb_lists.clear();
+
+	// inputs without data yet are left out
+	if ( this->inputs[0] != NULL && this->inputs[0]->getData() != NULL ) {
+		if ( this->inputs[0]->getFormat() == "GenericFiducial" )
+			this->obj_lists.push_back((moDataGenericList *)this->inputs[0]->getData());
+		else
+			this->cur_lists.push_back((moDataGenericList *)this->inputs[0]->getData());
+	}
+	if ( this->inputs[1] != NULL && this->inputs[1]->getData() != NULL )
+		this->obj_lists.push_back((moDataGenericList *)this->inputs[1]->getData());
+	if ( this->inputs[2] != NULL && this->inputs[2]->getData() != NULL )
+		this->blb_lists.push_back((moDataGenericList *)this->inputs[2]->getData());
+
+	// stamp the frame with the oldest input timestamp
+	timetag = 0.;
+	if ( this->property("timetag").asBool() ) {
+		for ( n = 0; n < TUIO_INPUT_COUNT; n++ ) {
+			if ( this->inputs[n] == NULL || this->inputs[n]->getData() == NULL )
+				continue;
+			if ( timetag == 0. || this->inputs[n]->getFrame().timestamp < timetag )
+				timetag = this->inputs[n]->getFrame().timestamp;
+		}
+	}
 
+	this->encoder.beginFrame(this->fseq++, timetag);
+	if ( !this->cur_lists.empty() )
+		this->encodeCursors();
+	if ( !this->obj_lists.empty() )
+		this->encodeObjects();
+	if ( !this->blb_lists.empty() )
+		this->encodeBlobs();
+	this->encoder.endFrame();
+
+	this->unlockInputs();
+
+	// encode once, send to every destination
+	for ( i = 0; i < this->encoder.getPacketCount(); i++ ) {
+		const moOSCPacket &packet = this->encoder.getPacket(i);
+		for ( it = this->osc.begin(); it != this->osc.end(); it++ )
+			(*it)->send(packet.getBuffer(), packet.size());
+	}
+}
 
-		bundle = new WOscBundle();
-		WOscMessage *msg = new WOscMessage("/tuio/2Dcur");
-		msg->Add("alive");
+void moTuioModule::encodeCursors() {
+	// /tuio/2Dcur set s x y X Y m [w h]
+	std::vector<moDataGenericList *>::iterator lit;
+	moDataGenericList::iterator it;
+	bool sendsize = this->property("sendsize").asBool();
+	int id;
 
-		moDataGenericList::iterator it;
-		moDataGenericList *list = (moDataGenericList *)this->input->getData();
-		for ( it = list->begin(); it != list->end(); it++ ) {
+	this->encoder.beginProfile("/tuio/2Dcur");
+	for ( lit = this->cur_lists.begin(); lit != this->cur_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
 			assert((*it)->properties["type"]->asString() == "blob");
-			msg->Add(atoi((*it)->properties["id"]->asString().c_str()));
+			this->encoder.addAlive((*it)->properties["id"]->asInteger());
 		}
+	}
 
-		bundle->Add(msg);
+	for ( lit = this->cur_lists.begin(); lit != this->cur_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
+			id = (*it)->properties["id"]->asInteger();
+			moOSCPacket &msg = this->encoder.beginSet(sendsize ? "ifffff" "ff" : "ifffff");
+			msg.addInt(id); // session id
+			msg.addFloat((float)(*it)->properties["x"]->asDouble()); // x
+			msg.addFloat((float)(*it)->properties["y"]->asDouble()); // y
+			msg.addFloat(_motion(*it, "vx")); // X
+			msg.addFloat(_motion(*it, "vy")); // Y
+			msg.addFloat(_motion(*it, "accel")); // m
+			if ( sendsize ) {
+				msg.addFloat(_size(*it, "w", "width")); // w
+				msg.addFloat(_size(*it, "h", "height")); // h
+			}
+			this->encoder.endSet(id);
+		}
+	}
+	this->encoder.endProfile();
+}
 
-		for ( it = list->begin(); it != list->end(); it++ ) {
-			assert((*it)->properties["type"]->asString() == "blob");
+void moTuioModule::encodeObjects() {
+	// /tuio/2Dobj set s i x y a X Y A m r
+	std::vector<moDataGenericList *>::iterator lit;
+	moDataGenericList::iterator it;
+	int session;
+
+	this->encoder.beginProfile("/tuio/2Dobj");
+	for ( lit = this->obj_lists.begin(); lit != this->obj_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
+			assert((*it)->properties["type"]->asString() == "fiducial");
+			this->encoder.addAlive(_session(*it));
+		}
+	}
+
+	for ( lit = this->obj_lists.begin(); lit != this->obj_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
+			session = _session(*it);
+			moOSCPacket &msg = this->encoder.beginSet("iiffffffff");
+			msg.addInt(session); // session id
+			msg.addInt((*it)->properties["id"]->asInteger()); // class id
+			msg.addFloat((float)(*it)->properties["x"]->asDouble()); // x
+			msg.addFloat((float)(*it)->properties["y"]->asDouble()); // y
+			msg.addFloat((float)(*it)->properties["angle"]->asDouble()); // a
+			msg.addFloat(_motion(*it, "vx")); // X
+			msg.addFloat(_motion(*it, "vy")); // Y
+			msg.addFloat(0.); // A
+			msg.addFloat(_motion(*it, "accel")); // m
+			msg.addFloat(0.); // r
+			this->encoder.endSet(session);
+		}
+	}
+	this->encoder.endProfile();
+}
 
-			msg = new WOscMessage("/tuio/2Dcur");
-			msg->Add("set");
-			msg->Add((*it)->properties["id"]->asInteger()); // class id
-			msg->Add((float)(*it)->properties["x"]->asDouble()); // x
-			msg->Add((float)(*it)->properties["y"]->asDouble()); // y
-			msg->Add((float)0.); // X
-			msg->Add((float)0.); // Y
-			msg->Add((float)0.); // m
-//			if ( this->property("sendsize").asBool() ) {
-//				msg->Add((float)(*it)->properties["w"]->asDouble()); // w
-//				msg->Add((float)(*it)->properties["h"]->asDouble()); // h
-//			}
-			bundle->Add(msg);
+void moTuioModule::encodeBlobs() {
+	// /tuio/2Dblb set s x y a w h f X Y A m r
+	std::vector<moDataGenericList *>::iterator lit;
+	moDataGenericList::iterator it;
+	float w, h;
+	int id;
+
+	this->encoder.beginProfile("/tuio/2Dblb");
+	for ( lit = this->blb_lists.begin(); lit != this->blb_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
+			assert((*it)->properties["type"]->asString() == "blob");
+			this->encoder.addAlive((*it)->properties["id"]->asInteger());
 		}
+	}
 
-		msg = new WOscMessage("/tuio/2Dcur");
-		msg->Add("fseq");
-		msg->Add(this->fseq++);
-		bundle->Add(msg);
+	for ( lit = this->blb_lists.begin(); lit != this->blb_lists.end(); lit++ ) {
+		for ( it = (*lit)->begin(); it != (*lit)->end(); it++ ) {
+			id = (*it)->properties["id"]->asInteger();
+			w = _size(*it, "w", "width");
+			h = _size(*it, "h", "height");
+			moOSCPacket &msg = this->encoder.beginSet("ifffffffffff");
+			msg.addInt(id); // session id
+			msg.addFloat((float)(*it)->properties["x"]->asDouble()); // x
+			msg.addFloat((float)(*it)->properties["y"]->asDouble()); // y
+			msg.addFloat(_angle(*it)); // a
+			msg.addFloat(w); // w
+			msg.addFloat(h); // h
+			msg.addFloat(w * h); // f
+			msg.addFloat(_motion(*it, "vx")); // X
+			msg.addFloat(_motion(*it, "vy")); // Y
+			msg.addFloat(0.); // A
+			msg.addFloat(_motion(*it, "accel")); // m
+			msg.addFloat(0.); // r
+			this->encoder.endSet(id);
+		}
+	}
+	this->encoder.endProfile();
+}
 
-	} else {
-		LOGM(MO_ERROR, "Unsupported input type: " << input->getFormat());
-		this->setError("Unsupported input type");
+// the same stream can be connected on several inputs, lock it only once
+void moTuioModule::lockInputs() {
+	for ( int i = 0; i < TUIO_INPUT_COUNT; i++ ) {
+		if ( this->inputs[i] == NULL || this->isSharedInput(i) )
+			continue;
+		this->inputs[i]->lock();
 	}
+}
 
-	this->osc->send(bundle);
+void moTuioModule::unlockInputs() {
+	for ( int i = 0; i < TUIO_INPUT_COUNT; i++ ) {
+		if ( this->inputs[i] == NULL || this->isSharedInput(i) )
+			continue;
+		this->inputs[i]->unlock();
+	}
+}
 
-	delete bundle;
+// stream connected on another input than n
+bool moTuioModule::isConnected(moDataStream *stream, int n) {
+	for ( int i = 0; i < TUIO_INPUT_COUNT; i++ ) {
+		if ( i != n && this->inputs[i] == stream )
+			return true;
+	}
+	return false;
+}
 
-	this->input->unlock();
+bool moTuioModule::isSharedInput(int n) {
+	for ( int i = 0; i < n; i++ ) {
+		if ( this->inputs[i] == this->inputs[n] )
+			return true;
+	}
+	return false;
 }
 
 void moTuioModule::setInput(moDataStream *stream, int n) {
-	if ( n != 0 ) {
+	if ( n < 0 || n >= TUIO_INPUT_COUNT ) {
 		this->setError("Invalid input index");
 		return;
 	}
-	if ( this->input != NULL )
-		this->input->removeObserver(this);
-	this->input = stream;
+	// a stream connected on several inputs is observed only once
+	if ( this->inputs[n] != NULL && !this->isConnected(this->inputs[n], n) )
+		this->inputs[n]->removeObserver(this);
+	this->inputs[n] = stream;
+	this->join.reset();
 	if ( stream != NULL ) {
-		if ( stream->getFormat() != "GenericBlob" &&
+		if ( n == 0 && stream->getFormat() != "GenericBlob" &&
 			 stream->getFormat() != "GenericFiducial" ) {
 			this->setError("Input 0 accept only touch or fiducial");
-			this->input = NULL;
+			this->inputs[n] = NULL;
+			return;
+		}
+		if ( n == 1 && stream->getFormat() != "GenericFiducial" ) {
+			this->setError("Input 1 accept only fiducial");
+			this->inputs[n] = NULL;
+			return;
+		}
+		if ( n == 2 && stream->getFormat() != "GenericBlob" ) {
+			this->setError("Input 2 accept only blob");
+			this->inputs[n] = NULL;
 			return;
 		}
 	}
-	if ( this->input != NULL )
-		this->input->addObserver(this);
+	if ( this->inputs[n] != NULL && !this->isConnected(this->inputs[n], n) )
+		this->inputs[n]->addObserver(this);
 }
 
 moDataStream* moTuioModule::getInput(int n) {
-	if ( n != 0 ) {
+	if ( n < 0 || n >= TUIO_INPUT_COUNT ) {
 		this->setError("Invalid input index");
 		return NULL;
 	}
-	return this->input;
+	return this->inputs[n];
 }
 
 moDataStream* moTuioModule::getOutput(int n) {
@@ -225,4 +488,3 @@ moDataStream* moTuioModule::getOutput(int n) {
 void moTuioModule::update() {
 }
 
-
@@ -20,8 +20,14 @@
 #define MO_TUIO_MODULE_H
 
 #include <string>
+#include <vector>
 #include "../moModule.h"
 #include "../moOSC.h"
+#include "../moTuioEncoder.h"
+#include "../moDataGenericContainer.h"
+#include "../moFrameJoin.h"
+
+#define TUIO_INPUT_COUNT	3
 
 class moDataStream;
 
@@ -36,15 +42,33 @@ public:
 
 	void notifyData(moDataStream *stream);
 	void update();
+	void poll();
 
 	void start();
 	void stop();
 
 private:
-	moDataStream *input;
-	moOSC *osc;
+	moDataStream *inputs[TUIO_INPUT_COUNT];
+	moFrameJoin join;
+	std::vector<moOSC *> osc;
+	moTuioEncoder encoder;
 	int fseq;
 
+	std::vector<moDataGenericList *> cur_lists;
+	std::vector<moDataGenericList *> obj_lists;
+	std::vector<moDataGenericList *> blb_lists;
+
+	void closeDestinations();
+	int joinInputs(int *index);
+	void send();
+	void encodeCursors();
+	void encodeObjects();
+	void encodeBlobs();
+	void lockInputs();
+	void unlockInputs();
+	bool isSharedInput(int n);
+	bool isConnected(moDataStream *stream, int n);
+
 	MODULE_INTERNALS();
 };
 
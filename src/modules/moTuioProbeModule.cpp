@@ -0,0 +1,480 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+//
+// TUIO receiver, to check what a client get from the Tuio module.
+//
+// Bind an UDP port, decode the bundles with WOscLib, and follow the fseq
+// numbers to count lost and reordered frames. If the sender stamp the
+// bundles with the frame time (timetag property of Tuio), the latency
+// between the frame capture and the reception is measured too: this
+// only make sense on the same host (loopback), where clocks are the same.
+//
+// Each message of a bundle is checked against its type tags: a message
+// whose arguments don't fill exactly its size is counted as invalid, as
+// well as packets without fseq.
+//
+// Statistics are published every interval seconds in the read-only
+// properties. For automated tests, max_loss (percent), max_latency (p99,
+// in milliseconds) and max_invalid (-1 to disable) set an error on the
+// module when exceeded. With duration (seconds), the probe stop after
+// that time: if less than min_frames frames have been received, it set
+// an error, otherwise the module is finished, and movid -t exit with
+// success.
+//
+
+#include <string.h>
+#include <algorithm>
+#include <assert.h>
+
+#ifdef _WIN32
+	#include <WinSock2.h>
+	#define close(s) closesocket(s)
+#else
+	#include <errno.h>
+	#include <unistd.h>
+	#include <sys/types.h>
+	#include <sys/time.h>
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+#endif
+
+#include "WOscBundle.h"
+#include "WOscMessage.h"
+#include "WOscException.h"
+#include "WOscNetReturn.h"
+
+#include "moTuioProbeModule.h"
+#include "../moLog.h"
+#include "../moUtils.h"
+#include "../moOSCPacket.h"
+
+MODULE_DECLARE(TuioProbe, "native", "Receive TUIO, and measure loss and latency");
+
+// fseq far behind the last one: the sender have been restarted
+#define PROBE_RESTART_DISTANCE	32
+
+// WOscLib need a return address for each bundle, and delete it itself
+class moTuioProbeReturn : public WOscNetReturn {
+};
+
+static unsigned int _read_int32(const char *buf) {
+	return ((unsigned char)buf[0] << 24) | ((unsigned char)buf[1] << 16)
+		| ((unsigned char)buf[2] << 8) | (unsigned char)buf[3];
+}
+
+// size of a padded OSC string, or -1 if it doesn't end before len
+static int _padded_size(const char *buf, int len) {
+	int n;
+	for ( n = 0; n < len; n++ )
+		if ( buf[n] == '\0' )
+			return (n + 4) & ~3;
+	return -1;
+}
+
+// check a message against its type tags, return false if the arguments
+// don't end exactly at the end of the message
+static bool _check_message(const char *buf, int len) {
+	const char *types;
+	int offset, size;
+
+	size = _padded_size(buf, len);
+	if ( size < 0 || size >= len || buf[size] != ',' )
+		return false;
+	types = buf + size + 1;
+	offset = size;
+	size = _padded_size(buf + offset, len - offset);
+	if ( size < 0 )
+		return false;
+	offset += size;
+
+	for ( ; *types != '\0'; types++ ) {
+		switch ( *types ) {
+			case 'i': case 'f': case 'c': case 'r': case 'm':
+				size = 4;
+				break;
+			case 'h': case 't': case 'd':
+				size = 8;
+				break;
+			case 's': case 'S':
+				size = _padded_size(buf + offset, len - offset);
+				break;
+			case 'b':
+				size = -1;
+				if ( offset + 4 <= len && _read_int32(buf + offset) <= (unsigned int)len )
+					size = 4 + ((_read_int32(buf + offset) + 3) & ~3);
+				break;
+			case 'T': case 'F': case 'N': case 'I':
+				size = 0;
+				break;
+			default:
+				return false;
+		}
+		if ( size < 0 || offset + size > len )
+			return false;
+		offset += size;
+	}
+
+	return offset == len;
+}
+
+// number of malformed messages in a bundle, the bundle header is not checked
+static int _malformed_messages(const char *buf, int len) {
+	int offset, size, count = 0;
+
+	for ( offset = 16; offset < len; offset += size ) {
+		if ( offset + 4 > len )
+			return count + 1;
+		size = (int)_read_int32(buf + offset);
+		offset += 4;
+		if ( size < 0 || size > len - offset )
+			return count + 1;
+		// nested bundles are not used by TUIO
+		if ( size > 0 && buf[offset] == '#' )
+			continue;
+		if ( !_check_message(buf + offset, size) )
+			count++;
+	}
+
+	return count;
+}
+
+static void _probe_thread(moThread *thread) {
+	moTuioProbeModule *module = (moTuioProbeModule *)thread->getUserData();
+	while ( !thread->wantQuit() )
+		module->receive(100);
+}
+
+static void _set_stat(moProperty *property, int value) {
+	property->setReadOnly(false);
+	property->set(value);
+	property->setReadOnly(true);
+}
+
+static void _set_stat(moProperty *property, double value) {
+	property->setReadOnly(false);
+	property->set(value);
+	property->setReadOnly(true);
+}
+
+moTuioProbeModule::moTuioProbeModule() : moModule(MO_MODULE_NONE, 0, 0) {
+
+	MODULE_INIT();
+
+	this->sock = -1;
+	this->receiver = NULL;
+	this->last_report = 0.;
+	this->started = 0.;
+	this->reset();
+
+	// declare properties
+	this->properties["port"] = new moProperty(3333);
+	this->properties["interval"] = new moProperty(5.);
+	this->properties["window"] = new moProperty(1000);
+	this->properties["window"]->setMin(1);
+	this->properties["max_loss"] = new moProperty(100.);
+	this->properties["max_latency"] = new moProperty(0.);
+	this->properties["duration"] = new moProperty(0.);
+	this->properties["duration"]->setMin(0);
+	this->properties["min_frames"] = new moProperty(1);
+	this->properties["min_frames"]->setMin(0);
+	this->properties["max_invalid"] = new moProperty(-1);
+	this->properties["max_invalid"]->setMin(-1);
+
+	// statistics
+	this->properties["frames"] = new moProperty(0);
+	this->properties["lost"] = new moProperty(0);
+	this->properties["reordered"] = new moProperty(0);
+	this->properties["invalid"] = new moProperty(0);
+	this->properties["loss"] = new moProperty(0.);
+	this->properties["latency_p50"] = new moProperty(0.);
+	this->properties["latency_p95"] = new moProperty(0.);
+	this->properties["latency_p99"] = new moProperty(0.);
+	this->properties["frames"]->setReadOnly(true);
+	this->properties["lost"]->setReadOnly(true);
+	this->properties["reordered"]->setReadOnly(true);
+	this->properties["invalid"]->setReadOnly(true);
+	this->properties["loss"]->setReadOnly(true);
+	this->properties["latency_p50"]->setReadOnly(true);
+	this->properties["latency_p95"]->setReadOnly(true);
+	this->properties["latency_p99"]->setReadOnly(true);
+}
+
+moTuioProbeModule::~moTuioProbeModule() {
+	this->closeSocket();
+}
+
+void moTuioProbeModule::reset() {
+	this->have_fseq = false;
+	this->last_fseq = 0;
+	this->seen = 0;
+	this->packets = 0;
+	this->frames = 0;
+	this->lost = 0;
+	this->reordered = 0;
+	this->invalid = 0;
+	this->latencies.clear();
+	this->latency_index = 0;
+}
+
+void moTuioProbeModule::start() {
+	struct sockaddr_in addr;
+
+	this->closeSocket();
+	this->reset();
+
+	this->sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if ( this->sock == -1 ) {
+		LOGM(MO_ERROR, "unable to open socket");
+		this->setError("Unable to open socket");
+		return;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(this->property("port").asInteger());
+	if ( bind(this->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ) {
+		LOGM(MO_ERROR, "unable to bind port " << this->property("port").asInteger());
+		this->setError("Unable to bind port");
+		this->closeSocket();
+		return;
+	}
+
+	this->last_report = this->started = moUtils::time();
+	this->receiver = new moThread(_probe_thread, this);
+	this->receiver->start();
+
+	moModule::start();
+}
+
+void moTuioProbeModule::stop() {
+	if ( this->receiver != NULL ) {
+		this->receiver->stop();
+		this->receiver->waitfor();
+		delete this->receiver;
+		this->receiver = NULL;
+	}
+	this->closeSocket();
+	moModule::stop();
+}
+
+void moTuioProbeModule::closeSocket() {
+	if ( this->sock < 0 )
+		return;
+	close(this->sock);
+	this->sock = -1;
+}
+
+void moTuioProbeModule::receive(int timeout_ms) {
+	struct timeval tv;
+	unsigned int sec, frac;
+	double now, latency;
+	fd_set fds;
+	int len, fseq;
+
+	FD_ZERO(&fds);
+	FD_SET(this->sock, &fds);
+	tv.tv_sec = 0;
+	tv.tv_usec = timeout_ms * 1000;
+	if ( select(this->sock + 1, &fds, NULL, NULL, &tv) <= 0 )
+		return;
+
+	len = recv(this->sock, this->buffer, sizeof(this->buffer), 0);
+	if ( len <= 0 )
+		return;
+	now = moUtils::time();
+
+	this->lock();
+	this->packets++;
+
+	if ( len < 16 || this->buffer[0] != '#' ) {
+		this->invalid++;
+		this->unlock();
+		return;
+	}
+
+	// time tag of the bundle, 1 mean "immediately"
+	sec = _read_int32(this->buffer + 8);
+	frac = _read_int32(this->buffer + 12);
+	latency = -1.;
+	if ( sec != 0 )
+		latency = now - ((double)(sec - OSC_TIMETAG_EPOCH) + frac / 4294967296.);
+
+	// type tags must match the size of each message
+	this->invalid += _malformed_messages(this->buffer, len);
+
+	// a bundle contain one fseq per profile, all with the same value
+	fseq = -1;
+	try {
+		WOscBundle bundle(this->buffer, len, new moTuioProbeReturn());
+		// GetMessage() give us the ownership of the message
+		while ( bundle.GetNumMessages() > 0 ) {
+			WOscMessage *msg = bundle.GetMessage(0);
+			if ( msg->GetNumStrings() > 0 && msg->GetNumInts() > 0 &&
+				 strcmp(msg->GetString(0).GetBuffer(), "fseq") == 0 )
+				fseq = msg->GetInt(0);
+			delete msg;
+		}
+	} catch ( WOscException *e ) {
+		LOGM(MO_DEBUG, "unable to decode packet: " << e->GetDescription());
+		delete e;
+		fseq = -1;
+	}
+
+	if ( fseq < 0 )
+		this->invalid++;
+	else
+		this->account(fseq, latency);
+
+	this->unlock();
+}
+
+void moTuioProbeModule::account(int fseq, double latency) {
+	int distance;
+
+	if ( this->have_fseq ) {
+		distance = fseq - this->last_fseq;
+
+		// other packet of the same frame
+		if ( distance == 0 )
+			return;
+
+		if ( distance < 0 && -distance < PROBE_RESTART_DISTANCE ) {
+			// late frame, already counted as lost
+			if ( this->seen & (1u << -distance) )
+				return;
+			this->seen |= (1u << -distance);
+			this->reordered++;
+			if ( this->lost > 0 )
+				this->lost--;
+		} else if ( distance > 0 ) {
+			this->lost += distance - 1;
+			this->seen = distance < PROBE_RESTART_DISTANCE ? (this->seen << distance) | 1 : 1;
+			this->last_fseq = fseq;
+		} else {
+			LOGM(MO_INFO, "fseq restarted from " << fseq);
+			this->reset();
+		}
+	}
+
+	if ( !this->have_fseq ) {
+		this->have_fseq = true;
+		this->last_fseq = fseq;
+		this->seen = 1;
+	}
+
+	this->frames++;
+
+	if ( latency < 0. )
+		return;
+	if ( this->latencies.size() < (unsigned int)this->property("window").asInteger() )
+		this->latencies.push_back(latency);
+	else {
+		this->latency_index %= this->latencies.size();
+		this->latencies[this->latency_index++] = latency;
+	}
+}
+
+double moTuioProbeModule::percentile(double p) {
+	unsigned int n;
+	if ( this->sorted.empty() )
+		return 0.;
+	n = (unsigned int)(p * (this->sorted.size() - 1) + 0.5);
+	std::nth_element(this->sorted.begin(), this->sorted.begin() + n, this->sorted.end());
+	return this->sorted[n];
+}
+
+void moTuioProbeModule::poll() {
+	this->notifyUpdate();
+	moModule::poll();
+}
+
+void moTuioProbeModule::update() {
+	double now = moUtils::time();
+	double loss, p50, p95, p99, duration;
+	bool done;
+
+	if ( this->isFinished() )
+		return;
+
+	// the last report is done at the end of the duration
+	duration = this->property("duration").asDouble();
+	done = duration > 0. && now - this->started >= duration;
+	if ( !done && now - this->last_report < this->property("interval").asDouble() )
+		return;
+	this->last_report = now;
+
+	this->lock();
+
+	loss = 0.;
+	if ( this->frames + this->lost > 0 )
+		loss = 100. * this->lost / (double)(this->frames + this->lost);
+	this->sorted = this->latencies;
+	p50 = this->percentile(0.50) * 1000.;
+	p95 = this->percentile(0.95) * 1000.;
+	p99 = this->percentile(0.99) * 1000.;
+
+	_set_stat(this->properties["frames"], (int)this->frames);
+	_set_stat(this->properties["lost"], (int)this->lost);
+	_set_stat(this->properties["reordered"], (int)this->reordered);
+	_set_stat(this->properties["invalid"], (int)this->invalid);
+	_set_stat(this->properties["loss"], loss);
+	_set_stat(this->properties["latency_p50"], p50);
+	_set_stat(this->properties["latency_p95"], p95);
+	_set_stat(this->properties["latency_p99"], p99);
+
+	LOGM(MO_INFO, "packets=" << this->packets << " frames=" << this->frames
+		<< " lost=" << this->lost << " (" << loss << "%) reordered=" << this->reordered
+		<< " invalid=" << this->invalid << " latency p50=" << p50
+		<< "ms p95=" << p95 << "ms p99=" << p99 << "ms");
+
+	if ( loss > this->property("max_loss").asDouble() )
+		this->setError("Loss exceed max_loss");
+	if ( this->property("max_latency").asDouble() > 0. &&
+		 p99 > this->property("max_latency").asDouble() )
+		this->setError("Latency exceed max_latency");
+	if ( this->property("max_invalid").asInteger() >= 0 &&
+		 this->invalid > (unsigned int)this->property("max_invalid").asInteger() )
+		this->setError("Invalid messages exceed max_invalid");
+
+	if ( done ) {
+		if ( this->frames < (unsigned int)this->property("min_frames").asInteger() )
+			this->setError("Not enough frames received");
+		else
+			LOGM(MO_INFO, "probe done after " << duration << "s");
+		this->setFinished();
+	}
+
+	this->unlock();
+}
+
+void moTuioProbeModule::setInput(moDataStream *stream, int n) {
+	this->setError("no input supported");
+}
+
+moDataStream* moTuioProbeModule::getInput(int n) {
+	return NULL;
+}
+
+moDataStream* moTuioProbeModule::getOutput(int n) {
+	this->setError("no output supported");
+	return NULL;
+}
+
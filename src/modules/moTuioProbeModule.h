@@ -0,0 +1,75 @@
+/***********************************************************************
+ ** Copyright (C) 2010 Movid Authors.  All rights reserved.
+ **
+ ** This file is part of the Movid Software.
+ **
+ ** This file may be distributed under the terms of the Q Public License
+ ** as defined by Trolltech AS of Norway and appearing in the file
+ ** LICENSE included in the packaging of this file.
+ **
+ ** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+ ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ **
+ ** Contact info@movid.org if any conditions of this licensing are
+ ** not clear to you.
+ **
+ **********************************************************************/
+
+
+#ifndef MO_TUIO_PROBE_MODULE_H
+#define MO_TUIO_PROBE_MODULE_H
+
+#include <vector>
+#include "../moModule.h"
+#include "../moThread.h"
+
+class moDataStream;
+
+class moTuioProbeModule : public moModule {
+public:
+	moTuioProbeModule();
+	virtual ~moTuioProbeModule();
+
+	virtual void setInput(moDataStream* stream, int n=0);
+	virtual moDataStream *getInput(int n=0);
+	virtual moDataStream *getOutput(int n=0);
+
+	void start();
+	void stop();
+	void poll();
+	void update();
+
+	// called from the receiver thread
+	void receive(int timeout_ms);
+
+private:
+	int sock;
+	moThread *receiver;
+	char buffer[65536];
+
+	bool have_fseq;
+	int last_fseq;
+	unsigned int seen;		// fseq received, bit n is last_fseq - n
+	unsigned int packets;
+	unsigned int frames;
+	unsigned int lost;
+	unsigned int reordered;
+	unsigned int invalid;
+
+	// latency of the last frames, in seconds
+	std::vector<double> latencies;
+	unsigned int latency_index;
+	std::vector<double> sorted;
+	double last_report;
+	double started;
+
+	void reset();
+	void closeSocket();
+	void account(int fseq, double latency);
+	double percentile(double p);
+
+	MODULE_INTERNALS();
+};
+
+#endif
+
@@ -41,6 +41,7 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <list>
 
 // opencv (for cvWaitKey)
 #include "cv.h"
@@ -57,15 +58,25 @@
 #include "moFactory.h"
 #include "moProperty.h"
 #include "moDataStream.h"
+#include "moStreamBroadcaster.h"
+#include "moUtils.h"
+#include "moThread.h"
 
 // libevent
 #include "event.h"
 #include "evhttp.h"
+#include "http-internal.h"
 
 #define MO_DAEMON	"movid"
 #define MO_GUIDIR	"gui/html"
 #define MO_VERSION	"0.2"
 
+// stream clients: default max fps, and don't send a new image while more
+// than MO_STREAM_BUFFER_MAX bytes are waiting in the connection
+#define MO_STREAM_DEFAULT_FPS	10
+#define MO_STREAM_BUFFER_MAX	(256 * 1024)
+#define MO_STREAM_RETRY			0.02
+
 LOG_DECLARE("App");
 
 static moPipeline *pipeline = NULL;
@@ -81,95 +92,187 @@ static std::string config_pidfile = "/var/run/movid.pid";
 static struct evhttp *server = NULL;
 int g_config_delay = 5;
 
-class otStreamModule : public moModule {
-public:
-	otStreamModule() : moModule(MO_MODULE_INPUT, 1, 0) {
-		this->input = new moDataStream("stream");
-		this->output_buffer = NULL;
-		this->properties["id"] = new moProperty(moModule::createId("WebStream"));
-		this->properties["scale"] = new moProperty(1);
-	}
+struct chunk_req_state {
+	struct evhttp_request *req;
+	moStreamBroadcaster *broadcaster;
+	std::vector<unsigned char> jpeg;
+	unsigned int sequence;
+	struct event timer;
+	bool scheduled;
+	double interval;
+	double last;
+};
 
-	void stop() {
-		if ( this->output_buffer != NULL ) {
-			cvReleaseImage(&this->output_buffer);
-			this->output_buffer = NULL;
-		}
-		moModule::stop();
-	}
+// the http server run in its own thread. The requests that change the
+// pipeline are queued as commands, and applied by the main loop between two
+// frames, on a copy of the request (local). The reply is then sent by the
+// http thread. The read only requests are served by the http thread, with
+// web_pipeline_mtx locked: the commands are applied, and the frames are
+// processed, with the same lock, so a read never see a command half
+// applied or a property being changed by a module. A read wait at most one
+// frame, and must not change anything (no property() with a name that may
+// not exist).
+typedef struct web_command {
+	void (*callback)(struct evhttp_request *req, void *arg);
+	void *arg;
+	void (*reply)(struct web_command *command);
+	void *userdata;
+	struct evhttp_request *req;
+	struct evhttp_request *local;
+	int code;
+	std::string reason;
+	struct evbuffer *evb;
+} web_command_t;
 
-	void notifyData(moDataStream *source) {
-		IplImage* src = (IplImage*)(this->input->getData());
-		if ( src == NULL )
-			return;
-		if ( this->output_buffer == NULL ) {
-			CvSize size = cvGetSize(src);
-			size.width /= this->property("scale").asInteger();
-			size.height /= this->property("scale").asInteger();
-			this->output_buffer = cvCreateImage(size, src->depth, src->nChannels);
-		}
-		this->notifyUpdate();
-	}
+typedef struct {
+	const char *uri;
+	void (*callback)(struct evhttp_request *req, void *arg);
+} web_route_t;
 
-	void setInput(moDataStream* stream, int n=0) {
-		if ( this->input != NULL )
-			this->input->removeObserver(this);
-		this->input = stream;
-		if ( this->input != NULL )
-			this->input->addObserver(this);
-	}
+static std::list<web_command_t *> web_commands;
+static std::list<web_command_t *> web_replies;
+static pt::mutex web_mtx;
+static pt::mutex web_pipeline_mtx;
+static moThread *web_thread = NULL;
 
-	virtual moDataStream *getInput(int n=0) {
-		return this->input;
-	}
+// all the stream clients (http thread only)
+static std::list<chunk_req_state *> stream_clients;
+
+// socket pair used to wake up the http thread, when a reply is ready, a
+// broadcaster have a new image, or the daemon quit
+static int web_wakeup[2] = { -1, -1 };
+static struct event web_wakeup_event;
+
+
+static void signal_term(int signal) {
+	want_quit = true;
+}
+
+//
+// WEB CALLBACKS
+//
+
+static void web_notify() {
+	// if the socket is full, a wake up is already pending
+	send(web_wakeup[1], "", 1, 0);
+}
 
-	virtual moDataStream *getOutput(int n=0) {
-		return NULL;
+// send the reply, or keep it in the command if the request is a local copy
+static void web_reply(struct evhttp_request *req, int code, const char *reason, struct evbuffer *evb) {
+	web_command_t *command;
+
+	if ( req->evcon != NULL ) {
+		evhttp_send_reply(req, code, reason, evb);
+		return;
 	}
 
-	bool copy() {
-		IplImage *src;
-		if ( this->output_buffer == NULL || this->input == NULL )
-			return false;
-		this->input->lock();
-		src = (IplImage*)(this->input->getData());
-		if ( src == NULL || src->imageData == NULL ) {
-			this->input->unlock();
-			return false;
-		}
-		if ( this->property("scale").asInteger() == 1 )
-			cvCopy(src, this->output_buffer);
-		else
-			cvResize(src, this->output_buffer);
-		this->input->unlock();
-		return true;
+	command = static_cast<web_command_t *>(req->cb_arg);
+	command->code = code;
+	command->reason = reason;
+	command->evb = evbuffer_new();
+	if ( command->evb != NULL && evb != NULL )
+		evbuffer_add_buffer(command->evb, evb);
+}
+
+static web_command_t *web_command_new(void (*callback)(struct evhttp_request *, void *), void *arg) {
+	web_command_t *command = new web_command_t();
+	command->callback = callback;
+	command->arg = arg;
+	command->reply = NULL;
+	command->userdata = NULL;
+	command->req = NULL;
+	command->local = NULL;
+	command->code = 0;
+	command->evb = NULL;
+	return command;
+}
+
+static void web_command_free(web_command_t *command) {
+	if ( command->req != NULL )
+		evhttp_connection_set_closecb(command->req->evcon, NULL, NULL);
+	if ( command->local != NULL )
+		evhttp_request_free(command->local);
+	if ( command->evb != NULL )
+		evbuffer_free(command->evb);
+	delete command;
+}
+
+static void web_command_push(web_command_t *command) {
+	web_mtx.lock();
+	web_commands.push_back(command);
+	web_mtx.unlock();
+}
+
+// the client is gone before the reply
+static void web_command_close(struct evhttp_connection *conn, void *arg) {
+	web_command_t *command = static_cast<web_command_t *>(arg);
+	evhttp_connection_set_closecb(conn, NULL, NULL);
+	command->req = NULL;
+}
+
+// http thread: send the reply prepared on the local request
+static void web_command_reply(web_command_t *command) {
+	struct evkeyval *header;
+
+	if ( command->req == NULL )
+		return;
+
+	if ( command->evb == NULL ) {
+		evhttp_send_error(command->req, HTTP_SERVUNAVAIL, "No reply");
+		return;
 	}
 
-	virtual void update() {}
-	virtual std::string getName() { return "Stream"; }
-	virtual std::string getDescription() { return ""; }
-	virtual std::string getAuthor() { return ""; }
+	TAILQ_FOREACH(header, command->local->output_headers, next)
+		evhttp_add_header(command->req->output_headers, header->key, header->value);
+	evhttp_send_reply(command->req, command->code, command->reason.c_str(), command->evb);
+}
+
+// http thread: queue the request for the main loop
+static void web_command_queue(struct evhttp_request *req, void *arg) {
+	web_route_t *route = static_cast<web_route_t *>(arg);
+	web_command_t *command = web_command_new(route->callback, NULL);
 
-	moDataStream *input;
-	IplImage* output_buffer;
-};
+	command->reply = web_command_reply;
+	command->req = req;
+	command->local = evhttp_request_new(NULL, command);
+	command->local->uri = strdup(req->uri);
+	evhttp_connection_set_closecb(req->evcon, web_command_close, command);
 
-struct chunk_req_state {
-	struct evhttp_request *req;
-	otStreamModule *stream;
-	int i;
-	bool closed;
-	int delay;
-};
+	web_command_push(command);
+}
 
+// main loop: apply the queued commands, between two frames
+static void web_commands_apply() {
+	std::list<web_command_t *> commands;
+	std::list<web_command_t *>::iterator it;
 
-static void signal_term(int signal) {
-	want_quit = true;
+	web_mtx.lock();
+	commands.swap(web_commands);
+	web_mtx.unlock();
+
+	if ( commands.empty() )
+		return;
+
+	web_pipeline_mtx.lock();
+	for ( it = commands.begin(); it != commands.end(); it++ )
+		(*it)->callback((*it)->local, (*it)->arg);
+	web_pipeline_mtx.unlock();
+
+	web_mtx.lock();
+	web_replies.splice(web_replies.end(), commands);
+	web_mtx.unlock();
+
+	web_notify();
 }
 
-//
-// WEB CALLBACKS
-//
+// http thread: read the pipeline, without command applied in the same time
+static void web_pipeline_read(struct evhttp_request *req, void *arg) {
+	web_route_t *route = static_cast<web_route_t *>(arg);
+
+	web_pipeline_mtx.lock();
+	route->callback(req, NULL);
+	web_pipeline_mtx.unlock();
+}
 
 void web_json(struct evhttp_request *req, cJSON *root) {
 	struct evbuffer *evb = evbuffer_new();
@@ -180,7 +283,7 @@ void web_json(struct evhttp_request *req, cJSON *root) {
 
 	evbuffer_add(evb, out, strlen(out));
 	evhttp_add_header(req->output_headers, "Content-Type", "application/json");
-	evhttp_send_reply(req, HTTP_OK, "Everything is fine", evb);
+	web_reply(req, HTTP_OK, "Everything is fine", evb);
 	evbuffer_free(evb);
 
 	free(out);
@@ -201,93 +304,171 @@ void web_status(struct evhttp_request *req, void *arg) {
 	web_message(req, "ok");
 }
 
+static void web_pipeline_stream_release(struct evhttp_request *req, void *arg) {
+	moStreamBroadcaster::release(static_cast<moStreamBroadcaster *>(arg));
+}
+
 static void web_pipeline_stream_close(struct evhttp_connection *conn, void *arg) {
 	struct chunk_req_state *state = static_cast<chunk_req_state*>(arg);
-	state->closed = true;
+
+	evhttp_connection_set_closecb(conn, NULL, NULL);
+	if ( state->scheduled )
+		event_del(&state->timer);
+	stream_clients.remove(state);
+
+	// the broadcaster stop to observe the stream between two frames
+	web_command_push(web_command_new(web_pipeline_stream_release, state->broadcaster));
+	delete state;
 }
 
-static void web_pipeline_stream_trickle(int fd, short events, void *arg) {
+static void web_pipeline_stream_timer(int fd, short events, void *arg);
+
+static void web_pipeline_stream_send(struct chunk_req_state *state) {
 	struct evbuffer *evb = NULL;
-	struct chunk_req_state *state = static_cast<chunk_req_state*>(arg);
 	struct timeval when = { 0, 0 };
-	long unsigned int outlen;
-	std::vector<uchar>outbuf;
-	std::vector<int> params;
-	IplImage* img;
-	bool convert = false;
-
-	when.tv_usec = state->delay * 1000;
-
-	// stream is closed, clean the state.
-	if ( state->closed ) {
-		state->stream->setInput(NULL);
-		delete state->stream;
-		free(state);
-		return;
-	}
-
-	// nothing to copy, schedule the next event
-	if ( !state->stream->copy() )
-		goto stream_trickle_end;
+	double now, wait;
 
-	// convert the image from BRG to RGB
-	img = state->stream->output_buffer;
-	if ( img == NULL ) {
-		LOG(MO_ERROR, "stream: output_buffer is null !");
-		goto stream_trickle_end;
-	}
+	// a timer is already pending, it will send the newest image
+	if ( state->scheduled )
+		return;
 
-	if ( img->nChannels == 3 )
-		cvCvtColor(img, img, CV_BGR2RGB);
+	// nothing new since the last chunk
+	if ( state->broadcaster->getSequence() == state->sequence )
+		return;
 
-	// if the depth is not a 8, create a temporary image, and convert to 8 bytes depth
-	if ( img->depth != 8 ) {
-		convert = true;
-		img = cvCreateImage(cvSize(img->width, img->height), IPL_DEPTH_8U, img->nChannels);
-		if ( img == NULL ) {
-			LOG(MO_ERROR, "stream: unable to create a new image");
-			goto stream_trickle_end;
-		}
-		cvConvertScale(state->stream->output_buffer, img, 255, 0);
+	// respect the max fps of the client, and don't queue images on a slow
+	// connection: wait, and send the newest image when it's possible
+	now = moUtils::time();
+	wait = state->last + state->interval - now;
+	if ( wait <= 0 && EVBUFFER_LENGTH(state->req->evcon->output_buffer) > MO_STREAM_BUFFER_MAX )
+		wait = MO_STREAM_RETRY;
+	if ( wait > 0 ) {
+		when.tv_sec = (long)wait;
+		when.tv_usec = (long)((wait - when.tv_sec) * 1000000);
+		evtimer_set(&state->timer, web_pipeline_stream_timer, state);
+		event_base_set(base, &state->timer);
+		evtimer_add(&state->timer, &when);
+		state->scheduled = true;
+		return;
 	}
 
-	// convert the image to JPEG
-	params.push_back(CV_IMWRITE_JPEG_QUALITY);
-	params.push_back(100);
-	cv::imencode(".jpg", img, outbuf, params);
-	outlen = outbuf.size();
-
-	// release temporary image if created
-	if ( convert )
-		cvReleaseImage(&img);
+	// the image is encoded once by the broadcaster, for all the clients.
+	if ( !state->broadcaster->getFrame(state->sequence, state->jpeg) )
+		return;
 
 	// create and send the buffer
 	evb = evbuffer_new();
 	if ( evb == NULL ) {
 		LOG(MO_ERROR, "stream: unable to create a libevent buffer");
-		goto stream_trickle_end;
+		return;
 	}
 	evbuffer_add_printf(evb, "--mjpegstream\r\n");
 	evbuffer_add_printf(evb, "Content-Type: image/jpeg\r\n");
-	evbuffer_add_printf(evb, "Content-Length: %lu\r\n\r\n", outlen);
-	evbuffer_add(evb, &outbuf[0], outlen);
+	evbuffer_add_printf(evb, "Content-Length: %lu\r\n\r\n", (long unsigned int)state->jpeg.size());
+	evbuffer_add(evb, &state->jpeg[0], state->jpeg.size());
 	evhttp_send_reply_chunk(state->req, evb);
 	evbuffer_free(evb);
 
-	outbuf.clear();
-	params.clear();
+	state->last = now;
+}
+
+static void web_pipeline_stream_timer(int fd, short events, void *arg) {
+	struct chunk_req_state *state = static_cast<chunk_req_state*>(arg);
+	state->scheduled = false;
+	web_pipeline_stream_send(state);
+}
+
+// a broadcaster have a new image (called from the broadcaster thread)
+static void web_pipeline_stream_notify(moStreamBroadcaster *broadcaster, void *userdata) {
+	web_notify();
+}
+
+// http thread: the stream is ready, start to send the images
+static void web_pipeline_stream_start(web_command_t *command) {
+	struct chunk_req_state *state = static_cast<chunk_req_state*>(command->userdata);
+	struct evhttp_request *req = command->req;
+
+	if ( req == NULL ) {
+		web_command_push(web_command_new(web_pipeline_stream_release, state->broadcaster));
+		delete state;
+		return;
+	}
+
+	state->req = req;
+	stream_clients.push_back(state);
+
+	// prepare connection
+	evhttp_add_header(req->output_headers, "Content-Type", "multipart/x-mixed-replace; boundary=mjpegstream");
+	evhttp_send_reply_start(req, HTTP_OK, "Everything is fine");
+	evhttp_connection_set_closecb(req->evcon, web_pipeline_stream_close, state);
+	command->req = NULL;
+
+	// send the last image now, the next ones when they are encoded
+	web_pipeline_stream_send(state);
+}
+
+// http thread: replies are ready, or new images to send
+static void web_wakeup_read(int fd, short events, void *arg) {
+	std::list<web_command_t *> replies;
+	std::list<web_command_t *>::iterator it;
+	std::list<chunk_req_state *>::iterator sit;
+	char buffer[64];
+
+	while ( recv(fd, buffer, sizeof(buffer), 0) > 0 );
+
+	web_mtx.lock();
+	replies.swap(web_replies);
+	web_mtx.unlock();
+
+	for ( it = replies.begin(); it != replies.end(); it++ ) {
+		if ( (*it)->reply != NULL )
+			(*it)->reply(*it);
+		web_command_free(*it);
+	}
+
+	for ( sit = stream_clients.begin(); sit != stream_clients.end(); sit++ )
+		web_pipeline_stream_send(*sit);
+
+	if ( want_quit )
+		event_base_loopbreak(base);
+}
+
+static void web_thread_process(moThread *thread) {
+	event_base_dispatch(base);
+}
 
-stream_trickle_end:;
-	event_once(-1, EV_TIMEOUT, web_pipeline_stream_trickle, state, &when);
+// http thread is gone: the queued commands and replies will never be
+// processed, only release the broadcasters they hold
+static void web_commands_drain() {
+	std::list<web_command_t *> commands;
+	std::list<web_command_t *>::iterator it;
+	struct chunk_req_state *state;
+
+	commands.swap(web_replies);
+	commands.splice(commands.end(), web_commands);
+
+	for ( it = commands.begin(); it != commands.end(); it++ ) {
+		if ( (*it)->callback == web_pipeline_stream_release )
+			(*it)->callback(NULL, (*it)->arg);
+		if ( (*it)->reply == web_pipeline_stream_start ) {
+			state = static_cast<chunk_req_state *>((*it)->userdata);
+			moStreamBroadcaster::release(state->broadcaster);
+			delete state;
+		}
+		web_command_free(*it);
+	}
 }
 
 void web_pipeline_stream(struct evhttp_request *req, void *arg) {
 	const char *uri;
 	int	idx = 0;
+	int scale = 1;
+	int quality = MO_STREAM_DEFAULT_QUALITY;
+	double fps;
 	moModule *module = NULL;
+	web_command_t *command;
 	struct chunk_req_state *state = NULL;
 	struct evkeyvalq headers;
-	struct timeval when = { 0, 20 };
 
 	uri = evhttp_request_uri(req);
 	if ( uri == NULL ) {
@@ -316,38 +497,43 @@ void web_pipeline_stream(struct evhttp_request *req, void *arg) {
 		return web_error(req, "invalid index");
 	}
 
-	state = (struct chunk_req_state*)malloc(sizeof(struct chunk_req_state));
-	if ( state == NULL ) {
-		evhttp_clear_headers(&headers);
-		return web_error(req, "unable to allocate state");
-	}
+	if ( evhttp_find_header(&headers, "scale") != NULL )
+		scale = atoi(evhttp_find_header(&headers, "scale"));
 
-	memset(state, 0, sizeof(struct chunk_req_state));
-	state->req		= req;
-	state->closed	= false;
-	state->delay	= 100;
-	state->stream	= new otStreamModule();
-	if ( state->stream == NULL ) {
+	if ( evhttp_find_header(&headers, "quality") != NULL )
+		quality = atoi(evhttp_find_header(&headers, "quality"));
+
+	if ( quality < 1 || quality > 100 ) {
 		evhttp_clear_headers(&headers);
-		free(state);
-		return web_error(req, "unable to allocate stream module");
+		return web_error(req, "invalid quality");
 	}
 
-	if ( evhttp_find_header(&headers, "scale") != NULL )
-		state->stream->property("scale").set(evhttp_find_header(&headers, "scale"));
+	state = new chunk_req_state();
+	state->req		= req;
+	state->sequence	= 0;
+	state->scheduled = false;
+	state->interval	= 1. / MO_STREAM_DEFAULT_FPS;
+	state->last		= 0;
 
+	// delay is the minimum time between two images, in ms
 	if ( evhttp_find_header(&headers, "delay") != NULL )
-		state->delay = atoi(evhttp_find_header(&headers, "delay"));
+		state->interval = atoi(evhttp_find_header(&headers, "delay")) / 1000.;
 
-	state->stream->setInput(module->getOutput(idx));
+	if ( evhttp_find_header(&headers, "fps") != NULL ) {
+		fps = atof(evhttp_find_header(&headers, "fps"));
+		state->interval = fps > 0 ? 1. / fps : 0;
+	}
 
-	// prepare connection
-	evhttp_add_header(req->output_headers, "Content-Type", "multipart/x-mixed-replace; boundary=mjpegstream");
-	evhttp_send_reply_start(req, HTTP_OK, "Everything is fine");
-	evhttp_connection_set_closecb(req->evcon, web_pipeline_stream_close, state);
+	// share the encoding with the clients of the same stream
+	state->broadcaster = moStreamBroadcaster::acquire(module->getOutput(idx), scale, quality);
+	state->broadcaster->setCallback(web_pipeline_stream_notify, NULL);
+
+	evhttp_clear_headers(&headers);
 
-	// reschedule a future event for next call
-	event_once(-1, EV_TIMEOUT, web_pipeline_stream_trickle, state, &when);
+	// the http thread will start the stream
+	command = static_cast<web_command_t *>(req->cb_arg);
+	command->userdata = state;
+	command->reply = web_pipeline_stream_start;
 }
 
 void web_pipeline_create(struct evhttp_request *req, void *arg) {
@@ -634,6 +820,7 @@ void web_pipeline_connect(struct evhttp_request *req, void *arg) {
 }
 
 void web_pipeline_get(struct evhttp_request *req, void *arg) {
+	std::map<std::string, moProperty*>::iterator it;
 	moModule *module;
 	struct evkeyvalq headers;
 	const char *uri;
@@ -662,7 +849,15 @@ void web_pipeline_get(struct evhttp_request *req, void *arg) {
 		return web_error(req, "object not found");
 	}
 
-	web_message(req, module->property(evhttp_find_header(&headers, "name")).asString().c_str());
+	// served by the http thread: property() would add an unknown name to
+	// the map that the module threads use
+	it = module->getProperties().find(evhttp_find_header(&headers, "name"));
+	if ( it == module->getProperties().end() ) {
+		evhttp_clear_headers(&headers);
+		return web_error(req, "property not found");
+	}
+
+	web_message(req, it->second->asString().c_str());
 	evhttp_clear_headers(&headers);
 }
 
@@ -781,7 +976,7 @@ void web_pipeline_dump(struct evhttp_request *req, void *arg) {
 
 	evbuffer_add(evb, out, strlen(out));
 	evhttp_add_header(req->output_headers, "Content-Type", "text/plain");
-	evhttp_send_reply(req, HTTP_OK, "OK", evb);
+	web_reply(req, HTTP_OK, "OK", evb);
 	evbuffer_free(evb);
 }
 
@@ -866,7 +1061,7 @@ void web_file(struct evhttp_request *req, void *arg) {
 void usage(void) {
 	printf("Usage: %s [options...]                                              \n" \
 		   "                                                                \n" \
-		   "  -t  --test                  Test mode, stop on the first error\n" \
+		   "  -t  --test                  Test mode, stop on the first error or when done\n" \
 		   "  -i  --info <modulename>     Show infos on a module            \n" \
 		   "  -s  --syslog                Send loggings to syslog           \n" \
 		   "  -d  --detach                Detach from console               \n" \
@@ -955,7 +1150,28 @@ int parse_options(int *argc, char ***argv) {
 	return -1; /* no error */
 }
 
+// requests applied by the main loop, between two frames
+static web_route_t web_command_routes[] = {
+	{ "/pipeline/create", web_pipeline_create },
+	{ "/pipeline/remove", web_pipeline_remove },
+	{ "/pipeline/connect", web_pipeline_connect },
+	{ "/pipeline/set", web_pipeline_set },
+	{ "/pipeline/stream", web_pipeline_stream },
+	{ "/pipeline/start", web_pipeline_start },
+	{ "/pipeline/stop", web_pipeline_stop },
+	{ "/pipeline/quit", web_pipeline_quit },
+};
+
+// requests served by the http thread
+static web_route_t web_read_routes[] = {
+	{ "/pipeline/status", web_pipeline_status },
+	{ "/pipeline/get", web_pipeline_get },
+	{ "/pipeline/dump", web_pipeline_dump },
+	{ "/pipeline/stats", web_pipeline_stats },
+};
+
 int main(int argc, char **argv) {
+	unsigned int i;
 	int ret, exit_ret = 0;
 
 	// initialize all signals
@@ -1036,20 +1252,26 @@ int main(int argc, char **argv) {
 		evhttp_set_cb(server, "/", web_index, NULL);
 		evhttp_set_cb(server, "/factory/list", web_factory_list, NULL);
 		evhttp_set_cb(server, "/factory/describe", web_factory_desribe, NULL);
-		evhttp_set_cb(server, "/pipeline/create", web_pipeline_create, NULL);
-		evhttp_set_cb(server, "/pipeline/remove", web_pipeline_remove, NULL);
-		evhttp_set_cb(server, "/pipeline/status", web_pipeline_status, NULL);
-		evhttp_set_cb(server, "/pipeline/connect", web_pipeline_connect, NULL);
-		evhttp_set_cb(server, "/pipeline/set", web_pipeline_set, NULL);
-		evhttp_set_cb(server, "/pipeline/get", web_pipeline_get, NULL);
-		evhttp_set_cb(server, "/pipeline/stream", web_pipeline_stream, NULL);
-		evhttp_set_cb(server, "/pipeline/start", web_pipeline_start, NULL);
-		evhttp_set_cb(server, "/pipeline/stop", web_pipeline_stop, NULL);
-		evhttp_set_cb(server, "/pipeline/quit", web_pipeline_quit, NULL);
-		evhttp_set_cb(server, "/pipeline/dump", web_pipeline_dump, NULL);
-		evhttp_set_cb(server, "/pipeline/stats", web_pipeline_stats, NULL);
+
+		for ( i = 0; i < sizeof(web_command_routes) / sizeof(web_route_t); i++ )
+			evhttp_set_cb(server, web_command_routes[i].uri, web_command_queue, &web_command_routes[i]);
+		for ( i = 0; i < sizeof(web_read_routes) / sizeof(web_route_t); i++ )
+			evhttp_set_cb(server, web_read_routes[i].uri, web_pipeline_read, &web_read_routes[i]);
 
 		evhttp_set_gencb(server, web_file, NULL);
+
+		if ( evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, web_wakeup) == -1 ) {
+			LOG(MO_CRITICAL, "unable to create the http server socket pair");
+			goto exit_critical;
+		}
+		evutil_make_socket_nonblocking(web_wakeup[0]);
+		evutil_make_socket_nonblocking(web_wakeup[1]);
+		event_set(&web_wakeup_event, web_wakeup[0], EV_READ|EV_PERSIST, web_wakeup_read, NULL);
+		event_base_set(base, &web_wakeup_event);
+		event_add(&web_wakeup_event, NULL);
+
+		web_thread = new moThread(web_thread_process, NULL);
+		web_thread->start();
 	}
 
 	// main loop
@@ -1057,26 +1279,54 @@ int main(int argc, char **argv) {
 		// FIXME remove this hack !!!
 		cvWaitKey(g_config_delay);
 
-		// update pipeline
+		// update pipeline, no read from the http server in the same time
+		web_pipeline_mtx.lock();
 		if ( pipeline->isStarted() ) {
 			pipeline->poll();
 
 			// check for error in pipeline
 			while ( pipeline->haveError() ) {
 				LOG(MO_ERROR, "Pipeline error: " << pipeline->getLastError());
-				if ( test_mode )
+				if ( test_mode ) {
 					want_quit = true;
+					exit_ret = 1;
+				}
+			}
+
+			// a module have done the test, stop with success
+			if ( test_mode && !want_quit && pipeline->isFinished() ) {
+				LOG(MO_INFO, "Pipeline finished");
+				want_quit = true;
 			}
 		}
+		web_pipeline_mtx.unlock();
 
-		// got a server, update
-		if ( server != NULL )
-			event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+		// apply the requests of the http server, between two frames
+		web_commands_apply();
 	}
 
 exit_standard:
+	if ( web_thread != NULL ) {
+		web_notify();
+		web_thread->waitfor();
+		delete web_thread;
+		web_thread = NULL;
+
+		// the streams are going away with the pipeline
+		for ( std::list<chunk_req_state *>::iterator it = stream_clients.begin();
+			  it != stream_clients.end(); it++ )
+			moStreamBroadcaster::release((*it)->broadcaster);
+		stream_clients.clear();
+
+		web_commands_drain();
+	}
 	if ( server != NULL )
 		evhttp_free(server);
+	if ( web_wakeup[0] != -1 ) {
+		event_del(&web_wakeup_event);
+		EVUTIL_CLOSESOCKET(web_wakeup[0]);
+		EVUTIL_CLOSESOCKET(web_wakeup[1]);
+	}
 	if ( base != NULL )
 		event_base_free(base);
 
@@ -1084,7 +1334,7 @@ exit_standard:
 		delete pipeline;
 	moDaemon::cleanup();
 
-	return 0;
+	return exit_ret;
 
 exit_critical:
 	exit_ret = 1;